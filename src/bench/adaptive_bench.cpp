@@ -0,0 +1,92 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Time to reach a target noise level on book_cover_world: fixed samples per
+// pixel against adaptive sampling. Noise is the RMSE of the displayed image
+// against a high sample reference rendered with an independent seed.
+
+#define BENCH_WIDTH       160
+#define BENCH_HEIGHT      90
+#define REFERENCE_SAMPLES 1024
+#define MAX_SAMPLES       512
+
+typedef struct {
+  f64 seconds;
+  f64 rmse;
+  u64 samples;
+} BenchResult;
+
+BenchResult renderAndMeasure(World* world, RenderSettings settings, const u8* reference, u8* texture_data){
+  RenderStats stats;
+  stats.samples  = 0;
+  stats.rays     = 0;
+  settings.stats = &stats;
+
+  auto start = std::chrono::steady_clock::now();
+  fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+  BenchResult result;
+  result.seconds = elapsedSeconds(start);
+  result.rmse    = imageRMSE(texture_data, reference, BENCH_WIDTH * BENCH_HEIGHT);
+  result.samples = stats.samples;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  f64 target_rmse = argc > 1 ? atof(argv[1]) : 0.02;
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+
+  RenderSettings settings = default_render_settings();
+  randState scene_state(settings.seed);
+  arena scene_memory;
+  World *world = book_cover_world(scene_memory, aspect_ratio, &scene_state);
+
+  u8 *reference    = (u8 *) malloc(pixels_count * 4);
+  u8 *texture_data = (u8 *) malloc(pixels_count * 4);
+
+  printf("Rendering %d spp reference...\n", REFERENCE_SAMPLES);
+  RenderSettings reference_settings = settings;
+  reference_settings.seed = settings.seed + 1;
+  world->pixel_samples    = REFERENCE_SAMPLES;
+  fullRayTrace(reference, BENCH_WIDTH, BENCH_HEIGHT, world, &reference_settings);
+
+  printf("\nTarget RMSE %.4f\n", target_rmse);
+  printf("%-10s %10s %12s %10s %10s\n", "mode", "setting", "samples/px", "rmse", "time (s)");
+
+  BenchResult fixed_hit = {0, 0, 0};
+  // Both sweeps grow by ~sqrt(2) in cost per step
+  for (f32 samples = 2; samples <= MAX_SAMPLES; samples *= 1.41421356f) {
+    i32 spp = (i32)(samples + 0.5f);
+    world->pixel_samples   = spp;
+    world->noise_threshold = 0;
+    BenchResult r = renderAndMeasure(world, settings, reference, texture_data);
+    printf("%-10s %10d %12.2f %10.4f %10.3f\n", "fixed", spp, (f64)r.samples / pixels_count, r.rmse, r.seconds);
+    if (r.rmse <= target_rmse) { fixed_hit = r; break; }
+  }
+
+  BenchResult adaptive_hit = {0, 0, 0};
+  for (f32 threshold = 0.08f; threshold > 0.001f; threshold *= 0.70710678f) {
+    world->pixel_samples        = MAX_SAMPLES;
+    world->adaptive_min_samples = 8;
+    world->noise_threshold      = threshold;
+    BenchResult r = renderAndMeasure(world, settings, reference, texture_data);
+    printf("%-10s %10.4f %12.2f %10.4f %10.3f\n", "adaptive", threshold, (f64)r.samples / pixels_count, r.rmse, r.seconds);
+    if (r.rmse <= target_rmse) { adaptive_hit = r; break; }
+  }
+
+  printf("\n");
+  if (fixed_hit.samples == 0 || adaptive_hit.samples == 0) {
+    printf("Target not reached within %d samples per pixel\n", MAX_SAMPLES);
+  } else {
+    printf("Time to target:  fixed %.3f s, adaptive %.3f s (%.2fx)\n", fixed_hit.seconds, adaptive_hit.seconds, fixed_hit.seconds / adaptive_hit.seconds);
+    printf("Samples saved:   %lld (%.1f%%)\n", (long long)fixed_hit.samples - (long long)adaptive_hit.samples,
+           100.0 * (1.0 - (f64)adaptive_hit.samples / fixed_hit.samples));
+  }
+
+  free(reference);
+  free(texture_data);
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Reproducible benchmark suite: renders a fixed list of scenes with fixed
+// seeds and writes one JSON document with timings and throughput, so runs
+// of different versions can be compared. Each scene runs in a forked child
+// so its peak RSS is not polluted by the scenes before it.
+
+#ifndef LUMINARA_VERSION
+#define LUMINARA_VERSION "unknown"
+#endif
+
+#define BENCH_SEED 970
+
+typedef struct {
+  const char* scene;
+  i32 width;
+  i32 height;
+  i32 pixel_samples;
+  i32 ray_max_depth;
+} BenchScene;
+
+static const BenchScene bench_scenes[] = {
+  {"simple",          640, 360, 16, 20},
+  {"book",            640, 360,  8, 20},
+  {"field:50000",     640, 360,  8, 20},
+  {"field:1000000",   640, 360,  8, 20},
+  {"mesh",            640, 360,  8, 20},
+  {"mesh:8",          640, 360,  8, 20},
+};
+
+// Runs in the child process, writes the JSON object of the scene to fd
+void runScene(const BenchScene* bench, const RenderSettings* base_settings, i32 fd){
+  RenderSettings settings = *base_settings;
+  RenderStats stats;
+  stats.samples  = 0;
+  stats.rays     = 0;
+  settings.stats = &stats;
+
+  f32 aspect_ratio = f32(bench->width) / f32(bench->height);
+  randState scene_state(BENCH_SEED);
+
+  arena scene_memory;
+  auto build_start = std::chrono::steady_clock::now();
+  World *world = create_world(scene_memory, bench->scene, aspect_ratio, &scene_state);
+  f64 build_seconds = elapsedSeconds(build_start);
+  world->pixel_samples = bench->pixel_samples;
+  world->ray_max_depth = bench->ray_max_depth;
+
+  u8 *texture_data = (u8 *) malloc(bench->width * bench->height * 4);
+  auto render_start = std::chrono::steady_clock::now();
+  fullRayTrace(texture_data, bench->width, bench->height, world, &settings);
+  f64 render_seconds = elapsedSeconds(render_start);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  u64 samples = stats.samples;
+  u64 rays    = stats.rays;
+  u32 objects_count   = world->objects_count;
+  u32 materials_count = world->materials_count;
+  size_t arena_bytes  = scene_memory.used;
+
+  auto release_start = std::chrono::steady_clock::now();
+  scene_memory.release();
+  f64 release_seconds = elapsedSeconds(release_start);
+
+  dprintf(fd,
+          "    {\"scene\": \"%s\", \"objects\": %u, \"materials\": %u, \"width\": %d, \"height\": %d, \"spp\": %d, \"max_depth\": %d,\n"
+          "     \"build_seconds\": %.6f, \"release_seconds\": %.6f, \"arena_bytes\": %zu, \"wall_seconds\": %.6f,\n"
+          "     \"primary_rays\": %llu, \"total_rays\": %llu,\n"
+          "     \"primary_rays_per_second\": %.1f, \"total_rays_per_second\": %.1f, \"samples_per_second\": %.1f,\n"
+          "     \"peak_rss_kb\": %ld}",
+          bench->scene, objects_count, materials_count, bench->width, bench->height, bench->pixel_samples, bench->ray_max_depth,
+          build_seconds, release_seconds, arena_bytes, render_seconds,
+          (unsigned long long)samples, (unsigned long long)rays,
+          samples / render_seconds, rays / render_seconds, samples / render_seconds,
+          usage.ru_maxrss);
+  free(texture_data);
+}
+
+int main(int argc, char** argv) {
+  const char* output_path = argc > 1 ? argv[1] : NULL;
+
+  RenderSettings settings = default_render_settings();
+  settings.seed = BENCH_SEED;
+  u32 threads   = render_threads(&settings);
+
+  std::string scenes_json;
+  u32 scenes_count = sizeof(bench_scenes) / sizeof(bench_scenes[0]);
+  for (u32 k = 0; k < scenes_count; k++) {
+    fprintf(stderr, "[%u/%u] %s\n", k + 1, scenes_count, bench_scenes[k].scene);
+
+    i32 fds[2];
+    if (pipe(fds) != 0) {
+      ERROR_RETURN(1, "Failed to create pipe\n");
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      runScene(&bench_scenes[k], &settings, fds[1]);
+      close(fds[1]);
+      _exit(0);
+    }
+    close(fds[1]);
+
+    char buffer[4096];
+    std::string scene_json;
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) scene_json.append(buffer, n);
+    close(fds[0]);
+
+    i32 status = 0;
+    waitpid(pid, &status, 0);
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || scene_json.empty()) {
+      ERROR_RETURN(1, "Scene %s failed\n", bench_scenes[k].scene);
+    }
+    if (!scenes_json.empty()) scenes_json += ",\n";
+    scenes_json += scene_json;
+  }
+
+  FILE* out = output_path ? fopen(output_path, "w") : stdout;
+  if (out == NULL) {
+    ERROR_RETURN(1, "Failed to open %s\n", output_path);
+  }
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"compiler\": \"%s\",\n  \"threads\": %u,\n  \"seed\": %d,\n  \"scenes\": [\n%s\n  ]\n}\n",
+          LUMINARA_VERSION, __VERSION__, threads, BENCH_SEED, scenes_json.c_str());
+  if (output_path) {
+    fclose(out);
+    fprintf(stderr, "Saved results to %s\n", output_path);
+  }
+  return 0;
+}
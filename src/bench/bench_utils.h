@@ -0,0 +1,60 @@
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+#include "../utils/utils.h"
+#include "../raytracer/worlds.h"
+
+// Timing, primary ray tracing and image error shared by the benches
+
+inline f64 elapsedSeconds(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Closest hit throughput in rays per second of jittered primary rays cycling
+// over a width x height image of the world camera
+inline f64 traceRays(World* world, hittable* collider, u32 rays_count, u32 width, u32 height, randState* random_state){
+  u32 hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (u32 k = 0; k < rays_count; k++) {
+    u32 pixel = k % (width * height);
+    f32 u     = f32(pixel % width + RANDOM_UNIFORM(random_state)) / f32(width);
+    f32 v     = f32(pixel / width + RANDOM_UNIFORM(random_state)) / f32(height);
+    ray r     = world->camera->get_ray(u, v, random_state);
+    hit_record rec;
+    if (collider->hit(r, rec)) hits++;
+  }
+  f64 seconds = elapsedSeconds(start);
+  if (hits == 0) printf("warning: no hits\n");
+  return rays_count / seconds;
+}
+
+// RMSE over the color channels of two RGBA8 images
+inline f64 imageRMSE(const u8* a, const u8* b, i32 pixels_count){
+  f64 sum = 0;
+  for (i32 p = 0; p < pixels_count; p++) {
+    for (i32 c = 0; c < 3; c++) {
+      f64 d = (a[4*p + c] - b[4*p + c]) / 255.0;
+      sum += d * d;
+    }
+  }
+  return sqrt(sum / (3.0 * pixels_count));
+}
+
+// Samples per pixel where a sweep of 1, 2, 4... spp with the given RMSE
+// reaches target, interpolated in log-log, NAN outside the sweep
+inline f64 samplesForRMSE(const f64* rmse, i32 levels, f64 target){
+  if (rmse[0] <= target) return 1;
+  for (i32 l = 1; l < levels; l++) {
+    if (rmse[l] > target) continue;
+    f64 a = log(rmse[l - 1]), b = log(rmse[l]);
+    f64 t = (log(target) - a) / (b - a);
+    return exp2(l - 1 + t);
+  }
+  return NAN;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "bench_utils.h"
+
+// Closest hit throughput of primary rays against the linear list, the BVH and
+// the BVH with SoA sphere leaves for growing sphere counts.
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 180
+// Ray-object tests allowed for the linear list, keeps the 1M run short
+#define LIST_TEST_BUDGET 200000000.0
+
+// Rays where the two colliders disagree on the closest hit. Grazing rays on the
+// ground sphere are ill conditioned in f32, so a handful of disagreements from
+// fused multiply-adds or a different leaf grouping are expected at 1M spheres
+u32 countMismatches(World* world, hittable* a, hittable* b, u32 rays_count, randState* random_state){
+  u32 mismatches = 0;
+  for (u32 k = 0; k < rays_count; k++) {
+    ray r = world->camera->get_ray(RANDOM_UNIFORM(random_state), RANDOM_UNIFORM(random_state), random_state);
+    hit_record rec_a, rec_b;
+    bool hit_a = a->hit(r, rec_a);
+    bool hit_b = b->hit(r, rec_b);
+    if (hit_a != hit_b || (hit_a && (rec_a.material_index != rec_b.material_index || fabsf(rec_a.t - rec_b.t) > 1e-4f * rec_a.t))) mismatches++;
+  }
+  return mismatches;
+}
+
+int main() {
+  const u32 sizes[] = {500, 50000, 1000000};
+  f32 aspect_ratio  = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+
+  printf("SIMD sphere leaves: %d lanes\n", SPHERE_SET_LANES);
+  printf("%10s %12s %16s %16s %16s %10s %10s\n", "spheres", "build (ms)", "list (rays/s)", "bvh (rays/s)", "simd (rays/s)",
+         "speedup", "mismatch");
+  for (u32 size : sizes) {
+    randState scene_state(970);
+    arena scene_memory;
+    World *world = sphere_field_world(scene_memory, aspect_ratio, size, &scene_state, COLLIDER_LIST);
+
+    auto start = std::chrono::steady_clock::now();
+    bvh *tree  = scene_memory.create<bvh>(scene_memory, world->objects, world->objects_count);
+    f64 build_ms = 1000.0 * elapsedSeconds(start);
+    bvh *simd_tree = scene_memory.create<bvh>(scene_memory, world->objects, world->objects_count, BVH_MAX_LEAF_SIZE, true);
+
+    u32 bvh_rays  = BENCH_WIDTH * BENCH_HEIGHT;
+    u32 list_rays = (u32)MIN(f64(bvh_rays), LIST_TEST_BUDGET / world->objects_count);
+
+    randState trace_state(1);
+    f64 list_rate = traceRays(world, world->collider, list_rays, BENCH_WIDTH, BENCH_HEIGHT, &trace_state);
+    f64 bvh_rate  = traceRays(world, tree, bvh_rays, BENCH_WIDTH, BENCH_HEIGHT, &trace_state);
+    f64 simd_rate = traceRays(world, simd_tree, bvh_rays, BENCH_WIDTH, BENCH_HEIGHT, &trace_state);
+    u32 mismatches = countMismatches(world, tree, simd_tree, 20000, &trace_state);
+    printf("%10u %12.2f %16.0f %16.0f %16.0f %9.1fx %10u\n", size, build_ms, list_rate, bvh_rate, simd_rate,
+           simd_rate / bvh_rate, mismatches);
+  }
+  return 0;
+}
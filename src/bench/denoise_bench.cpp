@@ -0,0 +1,82 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/denoise.h"
+#include "bench_utils.h"
+
+// Denoiser against more samples on book_cover_world. Noise is the RMSE of the
+// displayed image against a high sample reference with an independent seed.
+// Raw renders sweep 1 to MAX_SAMPLES spp, denoised renders 1 to 16 spp with
+// the filter time added, and each denoised render is matched to the raw spp
+// with the same RMSE, interpolated in log-log.
+
+#define BENCH_WIDTH       256
+#define BENCH_HEIGHT      144
+#define REFERENCE_SAMPLES 1024
+#define MAX_SAMPLES       256
+#define DENOISED_SAMPLES  16
+
+int main() {
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+
+  RenderSettings settings = default_render_settings();
+  randState scene_state(settings.seed);
+  arena scene_memory;
+  World *world = book_cover_world(scene_memory, aspect_ratio, &scene_state);
+
+  u8 *reference    = (u8 *) malloc(pixels_count * 4);
+  u8 *texture_data = (u8 *) malloc(pixels_count * 4);
+  framebuffer features(BENCH_WIDTH, BENCH_HEIGHT, AOV_FEATURES);
+  denoiser filter(BENCH_WIDTH, BENCH_HEIGHT);
+  DenoiseSettings denoise_settings = default_denoise_settings();
+
+  printf("Rendering %d spp reference...\n", REFERENCE_SAMPLES);
+  RenderSettings reference_settings = settings;
+  reference_settings.seed    = settings.seed + 1;
+  reference_settings.sampler = SAMPLER_SOBOL;
+  world->pixel_samples       = REFERENCE_SAMPLES;
+  fullRayTrace(reference, BENCH_WIDTH, BENCH_HEIGHT, world, &reference_settings);
+
+  const i32 levels = 9; // 1 to MAX_SAMPLES spp
+  f64 raw_rmse[levels], raw_seconds[levels];
+  printf("\n%-8s %12s %12s\n", "spp", "raw rmse", "time (s)");
+  for (i32 l = 0; l < levels; l++) {
+    world->pixel_samples = 1 << l;
+    auto start = std::chrono::steady_clock::now();
+    fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+    raw_seconds[l] = elapsedSeconds(start);
+    raw_rmse[l]    = imageRMSE(texture_data, reference, pixels_count);
+    printf("%-8d %12.5f %12.3f\n", 1 << l, raw_rmse[l], raw_seconds[l]);
+  }
+
+  printf("\nDenoised, %d passes, %u threads\n", denoise_settings.iterations, render_threads(&settings));
+  printf("%-8s %12s %12s %12s %14s %10s\n", "spp", "rmse", "render (s)", "denoise (s)", "raw spp match", "speedup");
+  settings.aovs = &features;
+  for (i32 spp = 1; spp <= DENOISED_SAMPLES; spp *= 2) {
+    world->pixel_samples = spp;
+    auto start = std::chrono::steady_clock::now();
+    fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+    f64 render_seconds = elapsedSeconds(start);
+    start = std::chrono::steady_clock::now();
+    filter.run(texture_data, &features, &denoise_settings, render_threads(&settings));
+    f64 denoise_seconds = elapsedSeconds(start);
+
+    f64 rmse = imageRMSE(texture_data, reference, pixels_count);
+    f64 match = samplesForRMSE(raw_rmse, levels, rmse);
+    printf("%-8d %12.5f %12.3f %12.3f", spp, rmse, render_seconds, denoise_seconds);
+    if (isnan(match)) {
+      printf(" %14s %10s\n", "> 256", "-");
+    } else {
+      // Raw render time at the matching spp, interpolated between the levels
+      f64 level = log2(match);
+      i32 below = MIN((i32)level, levels - 2);
+      f64 raw_time = raw_seconds[below] * pow(raw_seconds[below + 1] / raw_seconds[below], level - below);
+      printf(" %14.1f %9.1fx\n", match, raw_time / (render_seconds + denoise_seconds));
+    }
+  }
+
+  free(reference);
+  free(texture_data);
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "bench_utils.h"
+
+// Two level BVH over instances of one shared mesh: first against the same
+// copies baked into a single flat mesh (closest hit throughput and rays whose
+// hit differs), then with thousands of copies of a 1M triangle mesh: memory
+// and build time of the top level, time to rebuild it after every instance
+// moved and primary ray throughput.
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 180
+#define BENCH_RAYS   (BENCH_WIDTH * BENCH_HEIGHT * 4)
+
+static f64 megabytes(size_t bytes){ return bytes / (1024.0 * 1024.0); }
+
+triangle_mesh* sphereMesh(arena& memory, u32 stacks, u32 slices){
+  u32 *indices;
+  u32 triangles_count = uv_sphere_indices(memory, stacks, slices, &indices);
+  vec3 *normals       = uv_sphere_directions(memory, stacks, slices);
+  return memory.create<triangle_mesh>(memory, normals, normals, indices, triangles_count, 0, false);
+}
+
+// Randomly scaled and rotated copy on a grid cell of the field
+transform copyTransform(u32 a, u32 b, u32 copies_per_side, randState* random_state){
+  f32 offset = 0.5f * 1.2f * (copies_per_side - 1);
+  vec3 center(a * 1.2f - offset, 0.5f, b * 1.2f - offset);
+  vec3 axis = random_vec3(-1, 1, random_state) + vec3(0, 0, 1e-3f);
+  return transform::translation(center) * transform::rotation(axis, RANDOM_IN_RANGE(0, 2 * PI, random_state)) *
+         transform::scaling(random_vec3(0.2, 0.5, random_state));
+}
+
+Camera fieldCamera(u32 copies_per_side){
+  f32 offset = 0.5f * 1.2f * (copies_per_side - 1);
+  vec3 lookfrom(0, 0.4f * offset + 2, offset + 6);
+  vec3 lookat(0, 0, 0.3f * offset);
+  return Camera(lookfrom, lookat, vec3(0, 1, 0), 40, f32(BENCH_WIDTH) / f32(BENCH_HEIGHT), 0, (lookfrom - lookat).norm());
+}
+
+void makeRays(Camera* camera, ray* rays, u32 rays_count){
+  randState random_state(1);
+  for (u32 k = 0; k < rays_count; k++) {
+    u32 pixel = k % (BENCH_WIDTH * BENCH_HEIGHT);
+    f32 u     = f32(pixel % BENCH_WIDTH + RANDOM_UNIFORM(&random_state)) / f32(BENCH_WIDTH);
+    f32 v     = f32(pixel / BENCH_WIDTH + RANDOM_UNIFORM(&random_state)) / f32(BENCH_HEIGHT);
+    rays[k]   = camera->get_ray(u, v, &random_state);
+  }
+}
+
+f64 traceRays(const hittable* collider, const ray* rays, u32 rays_count, hit_record* records, bool* hits){
+  auto start = std::chrono::steady_clock::now();
+  for (u32 k = 0; k < rays_count; k++) hits[k] = collider->hit(rays[k], records[k]);
+  return rays_count / elapsedSeconds(start);
+}
+
+int main() {
+  ray *rays              = (ray *) malloc(BENCH_RAYS * sizeof(ray));
+  hit_record *records    = (hit_record *) malloc(BENCH_RAYS * sizeof(hit_record));
+  hit_record *references = (hit_record *) malloc(BENCH_RAYS * sizeof(hit_record));
+  bool *hits             = (bool *) malloc(BENCH_RAYS * sizeof(bool));
+  bool *reference_hits   = (bool *) malloc(BENCH_RAYS * sizeof(bool));
+
+  // The baked mesh transforms every vertex and normal of every copy
+  {
+    const u32 copies_per_side = 8;
+    arena memory;
+    randState random_state(970);
+    triangle_mesh *mesh = sphereMesh(memory, 64, 128);
+    u32 vertices_count  = (64 + 1) * (128 + 1);
+    u32 copies          = copies_per_side * copies_per_side;
+
+    hittable **objects = memory.array<hittable *>(copies);
+    vec3 *vertices     = memory.array<vec3>(copies * vertices_count);
+    vec3 *normals      = memory.array<vec3>(copies * vertices_count);
+    u32 *indices       = memory.array<u32>(copies * 3 * mesh->triangle_count);
+    for (u32 c = 0; c < copies; c++) {
+      transform to_world = copyTransform(c / copies_per_side, c % copies_per_side, copies_per_side, &random_state);
+      transform to_local = to_world.inverse();
+      objects[c] = memory.create<instance>(mesh, to_world);
+      for (u32 k = 0; k < vertices_count; k++) {
+        vertices[c * vertices_count + k] = to_world.point(mesh->vertices[k]);
+        normals[c * vertices_count + k]  = normalize(to_local.normal_from_inverse(mesh->normals[k]));
+      }
+      for (u32 k = 0; k < 3 * mesh->triangle_count; k++) {
+        indices[c * 3 * mesh->triangle_count + k] = c * vertices_count + mesh->indices[k];
+      }
+    }
+    hittable *baked    = memory.create<triangle_mesh>(memory, vertices, normals, indices, copies * mesh->triangle_count, 0, false);
+    hittable *two_level = make_collider(memory, objects, copies, COLLIDER_PRIMITIVES);
+
+    Camera camera = fieldCamera(copies_per_side);
+    makeRays(&camera, rays, BENCH_RAYS);
+    f64 baked_rate = traceRays(baked, rays, BENCH_RAYS, references, reference_hits);
+    f64 rate       = traceRays(two_level, rays, BENCH_RAYS, records, hits);
+    u32 mismatches = 0;
+    for (u32 k = 0; k < BENCH_RAYS; k++) {
+      if (hits[k] != reference_hits[k]) mismatches++;
+      else if (hits[k] && (fabsf(records[k].t - references[k].t) > 1e-4f * references[k].t ||
+                           dot(records[k].normal, references[k].normal) < 0.999f)) mismatches++;
+    }
+    printf("%u copies of %u triangles\n", copies, mesh->triangle_count);
+    printf("%-12s %16s %10s %10s\n", "bvh", "rays/s", "speedup", "mismatch");
+    printf("%-12s %16.0f %9.2fx %10s\n", "baked", baked_rate, 1.0, "-");
+    printf("%-12s %16.0f %9.2fx %10u\n", "two level", rate, rate / baked_rate, mismatches);
+  }
+
+  {
+    arena mesh_memory;
+    auto start = std::chrono::steady_clock::now();
+    triangle_mesh *mesh = sphereMesh(mesh_memory, 512, 1024);
+    f64 mesh_ms = 1000.0 * elapsedSeconds(start);
+    printf("\nBottom level: %u triangles, %.1f MB, built in %.0f ms\n", mesh->triangle_count, megabytes(mesh_memory.used),
+           mesh_ms);
+    printf("%-10s %12s %14s %12s %16s %16s\n", "copies", "top (MB)", "flat (MB)", "build (ms)", "rebuild (ms)", "rays/s");
+
+    const u32 sides[] = {8, 32, 64};
+    for (u32 copies_per_side : sides) {
+      arena top_memory;
+      randState random_state(970);
+      u32 copies = copies_per_side * copies_per_side;
+      start = std::chrono::steady_clock::now();
+      hittable **objects = top_memory.array<hittable *>(copies);
+      for (u32 c = 0; c < copies; c++) {
+        objects[c] = top_memory.create<instance>(mesh, copyTransform(c / copies_per_side, c % copies_per_side,
+                                                                     copies_per_side, &random_state));
+      }
+      primitive_bvh *top = top_memory.create<primitive_bvh>(top_memory, objects, copies);
+      f64 build_ms = 1000.0 * elapsedSeconds(start);
+
+      // Every copy moves, then only the top level is sorted again
+      for (u32 c = 0; c < copies; c++) {
+        instance &copy = top->instances[c];
+        copy.set_transform(transform::translation(random_vec3(-0.1, 0.1, &random_state)) * copy.to_world);
+      }
+      top->rebuild(top_memory);
+      size_t top_bytes = top_memory.used;
+      start = std::chrono::steady_clock::now();
+      top->rebuild(top_memory);
+      f64 rebuild_ms = 1000.0 * elapsedSeconds(start);
+      if (top_memory.used != top_bytes) printf("warning: the rebuild allocated %zu bytes\n", top_memory.used - top_bytes);
+
+      Camera camera = fieldCamera(copies_per_side);
+      makeRays(&camera, rays, BENCH_RAYS);
+      f64 rate = traceRays(top, rays, BENCH_RAYS, records, hits);
+      printf("%-10u %12.2f %14.0f %12.2f %16.2f %16.0f\n", copies, megabytes(top_bytes),
+             megabytes(copies * mesh_memory.used), build_ms, rebuild_ms, rate);
+    }
+  }
+
+  free(rays);
+  free(records);
+  free(references);
+  free(hits);
+  free(reference_hits);
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "bench_utils.h"
+
+// Build time against trace quality of the LBVH builders and the binned SAH
+// build on sphere fields: SAH cost of the tree, closest hit throughput of
+// primary rays and rays where the closest hit differs from the SAH tree.
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 180
+
+u32 countMismatches(World* world, hittable* a, hittable* b, u32 rays_count){
+  randState random_state(7);
+  u32 mismatches = 0;
+  for (u32 k = 0; k < rays_count; k++) {
+    ray r = world->camera->get_ray(RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state), &random_state);
+    hit_record rec_a, rec_b;
+    bool hit_a = a->hit(r, rec_a);
+    bool hit_b = b->hit(r, rec_b);
+    if (hit_a != hit_b || (hit_a && (rec_a.material_index != rec_b.material_index || rec_a.t != rec_b.t))) mismatches++;
+  }
+  return mismatches;
+}
+
+int main() {
+  const u32 sizes[] = {50000, 1000000};
+  f32 aspect_ratio  = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+
+  struct Builder {
+    const char *name;
+    BvhBuildSettings settings;
+  } builders[4];
+  builders[0].name = "sah";
+  builders[0].settings = default_bvh_build_settings();
+  builders[1].name = "lbvh 30 bit";
+  builders[1].settings = builders[0].settings;
+  builders[1].settings.builder     = BVH_BUILDER_LBVH;
+  builders[1].settings.morton_bits = 30;
+  builders[2].name = "lbvh 63 bit";
+  builders[2].settings = builders[1].settings;
+  builders[2].settings.morton_bits = 63;
+  builders[3].name = "lbvh 63 + treelet";
+  builders[3].settings = builders[2].settings;
+  builders[3].settings.treelet_rounds = 1;
+
+  printf("LBVH workers: %u\n", lbvh_threads(0, 1u << 30));
+  for (u32 size : sizes) {
+    randState scene_state(970);
+    arena scene_memory;
+    World *world = sphere_field_world(scene_memory, aspect_ratio, size, &scene_state, COLLIDER_LIST);
+
+    printf("\n%u spheres\n", world->objects_count);
+    printf("%-20s %12s %10s %16s %10s %10s\n", "builder", "build (ms)", "sah cost", "rays/s", "vs sah", "mismatch");
+    bvh *reference = NULL;
+    f64 reference_rate = 0;
+    for (const Builder &builder : builders) {
+      auto start = std::chrono::steady_clock::now();
+      bvh *tree  = scene_memory.create<bvh>(scene_memory, world->objects, world->objects_count, BVH_MAX_LEAF_SIZE, false,
+                                            &builder.settings);
+      f64 build_ms = 1000.0 * elapsedSeconds(start);
+
+      randState trace_state(1);
+      f64 rate = traceRays(world, tree, BENCH_WIDTH * BENCH_HEIGHT * 4, BENCH_WIDTH, BENCH_HEIGHT, &trace_state);
+      if (reference == NULL) {
+        reference      = tree;
+        reference_rate = rate;
+      }
+      u32 mismatches = countMismatches(world, reference, tree, 20000);
+      printf("%-20s %12.1f %10.2f %16.0f %9.2fx %10u\n", builder.name, build_ms, tree->tree.sah_cost(), rate,
+             rate / reference_rate, mismatches);
+    }
+  }
+  return 0;
+}
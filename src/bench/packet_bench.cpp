@@ -0,0 +1,125 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Primary ray packets on book_cover_world at 4K: closest hit throughput of
+// the camera rays on one thread, traced one at a time through the virtual BVH
+// and the tagged primitive BVH, then in packets of 4, 8 and 16 through the
+// primitive BVH. The full render is then timed with and without packets on
+// every thread and the images compared.
+
+#define BENCH_WIDTH  3840
+#define BENCH_HEIGHT 2160
+#define BENCH_SPP    1
+
+// Checksum of the hit distances so the single ray and packet runs can be compared
+typedef struct {
+  f64 rays_per_second;
+  u64 hits;
+  f64 t_sum;
+} PrimaryResult;
+
+PrimaryResult primarySingle(World* world, const hittable* collider, const RenderSettings* settings){
+  PrimaryResult result = {0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  for (i32 j = 0; j < BENCH_HEIGHT; j++) {
+    for (i32 i = 0; i < BENCH_WIDTH; i++) {
+      randState random_state;
+      ray r = cameraRay(i, j, 0, BENCH_WIDTH, BENCH_HEIGHT, world, settings, &random_state);
+      hit_record rec;
+      if (collider->hit(r, rec)) {
+        result.hits++;
+        result.t_sum += rec.t;
+      }
+    }
+  }
+  result.rays_per_second = (f64)BENCH_WIDTH * BENCH_HEIGHT / elapsedSeconds(start);
+  return result;
+}
+
+template <u32 N>
+PrimaryResult primaryPacket(World* world, const primitive_bvh* collider, const RenderSettings* settings){
+  PrimaryResult result = {0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  for (i32 by = 0; by < BENCH_HEIGHT; by += packet_block<N>::height) {
+    for (i32 bx = 0; bx < BENCH_WIDTH; bx += packet_block<N>::width) {
+      ray_packet<N> packet;
+      packet.active = 0;
+      for (u32 k = 0; k < N; k++) {
+        i32 i = bx + k % packet_block<N>::width;
+        i32 j = by + k / packet_block<N>::width;
+        if (i >= BENCH_WIDTH || j >= BENCH_HEIGHT) continue;
+        randState random_state;
+        packet.set(k, cameraRay(i, j, 0, BENCH_WIDTH, BENCH_HEIGHT, world, settings, &random_state));
+        packet.active |= 1u << k;
+      }
+
+      hit_record rec[N];
+      u32 hits = collider->hit_packet(packet, RAY_T_MIN, INF, rec);
+      for (u32 lanes = hits; lanes; lanes &= lanes - 1) {
+        result.hits++;
+        result.t_sum += rec[__builtin_ctz(lanes)].t;
+      }
+    }
+  }
+  result.rays_per_second = (f64)BENCH_WIDTH * BENCH_HEIGHT / elapsedSeconds(start);
+  return result;
+}
+
+f64 renderSeconds(World* world, RenderSettings settings, u32 packet_size, u8* texture_data){
+  settings.packet_size = packet_size;
+  auto start = std::chrono::steady_clock::now();
+  fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+  return elapsedSeconds(start);
+}
+
+void printPrimary(const char* name, PrimaryResult r, f64 base_rate){
+  printf("%-22s %16.0f %9.2fx %12llu %16.3f\n", name, r.rays_per_second, r.rays_per_second / base_rate,
+         (unsigned long long)r.hits, r.t_sum);
+}
+
+int main() {
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+  RenderSettings settings = default_render_settings();
+
+  arena scene_memory;
+  randState scene_state(settings.seed);
+  World *world = book_cover_world(scene_memory, aspect_ratio, &scene_state);
+  world->pixel_samples = BENCH_SPP;
+  hittable *bvh_collider = world->collider;
+  primitive_bvh *collider = (primitive_bvh *) make_collider(scene_memory, world->objects, world->objects_count, COLLIDER_PRIMITIVES);
+
+  printf("book_cover_world %dx%d, primary rays on 1 thread\n", BENCH_WIDTH, BENCH_HEIGHT);
+  printf("%-22s %16s %10s %12s %16s\n", "mode", "rays/s", "speedup", "hits", "sum of t");
+  PrimaryResult single = primarySingle(world, collider, &settings);
+  printPrimary("bvh simd, single", primarySingle(world, bvh_collider, &settings), single.rays_per_second);
+  printPrimary("primitives, single", single, single.rays_per_second);
+  printPrimary("primitives, packet 4", primaryPacket<4>(world, collider, &settings), single.rays_per_second);
+  printPrimary("primitives, packet 8", primaryPacket<8>(world, collider, &settings), single.rays_per_second);
+  printPrimary("primitives, packet 16", primaryPacket<16>(world, collider, &settings), single.rays_per_second);
+
+  u8 *single_image = (u8 *) malloc(pixels_count * 4);
+  u8 *packet_image = (u8 *) malloc(pixels_count * 4);
+  world->collider = collider;
+
+  printf("\nFull render, %d spp, %u threads\n", BENCH_SPP, render_threads(&settings));
+  printf("%-22s %12s %10s %10s\n", "mode", "time (s)", "speedup", "max diff");
+  f64 single_seconds = renderSeconds(world, settings, 0, single_image);
+  printf("%-22s %12.3f %9.2fx %10d\n", "single", single_seconds, 1.0, 0);
+  const u32 packet_sizes[] = {4, 8, 16};
+  for (u32 packet_size : packet_sizes) {
+    f64 seconds = renderSeconds(world, settings, packet_size, packet_image);
+    i32 max_diff = 0;
+    for (i32 k = 0; k < pixels_count * 4; k++) max_diff = MAX(max_diff, abs(single_image[k] - packet_image[k]));
+    char name[32];
+    snprintf(name, sizeof(name), "packet %u", packet_size);
+    printf("%-22s %12.3f %9.2fx %10d\n", name, seconds, single_seconds / seconds, max_diff);
+  }
+
+  free(single_image);
+  free(packet_image);
+  return 0;
+}
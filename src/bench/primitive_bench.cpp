@@ -0,0 +1,72 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Virtual hittable hierarchy against tagged primitive dispatch: both colliders
+// are SAH BVHs over the same objects, one calls hittable::hit on every leaf
+// object, the other switches on the type tag over flat arrays. Reports closest
+// hit throughput of camera rays and the full render time of each scene.
+
+#define BENCH_WIDTH  640
+#define BENCH_HEIGHT 360
+#define BENCH_SPP    8
+#define BENCH_RAYS   1000000
+
+f64 closestHitRate(World* world, hittable* collider){
+  randState random_state(1);
+  u32 hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (u32 k = 0; k < BENCH_RAYS; k++) {
+    ray r = world->camera->get_ray(RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state), &random_state);
+    hit_record rec;
+    if (collider->hit(r, rec)) hits++;
+  }
+  f64 seconds = elapsedSeconds(start);
+  if (hits == 0) printf("warning: no hits\n");
+  return BENCH_RAYS / seconds;
+}
+
+f64 renderSeconds(World* world, hittable* collider, u8* texture_data){
+  RenderSettings settings = default_render_settings();
+  world->collider = collider;
+  auto start = std::chrono::steady_clock::now();
+  fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+  return elapsedSeconds(start);
+}
+
+int main() {
+  const char* scenes[] = {"simple", "book", "field:50000", "field:1000000", "mesh"};
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+
+  u8 *virtual_image = (u8 *) malloc(pixels_count * 4);
+  u8 *tagged_image  = (u8 *) malloc(pixels_count * 4);
+
+  printf("%16s %18s %18s %10s %14s %14s %10s %10s\n", "scene", "virtual (rays/s)", "tagged (rays/s)", "speedup",
+         "virtual (s)", "tagged (s)", "speedup", "max diff");
+  for (const char* scene : scenes) {
+    randState scene_state(970);
+    arena scene_memory;
+    World *world = create_world(scene_memory, scene, aspect_ratio, &scene_state);
+    world->pixel_samples = BENCH_SPP;
+
+    hittable *virtual_collider = make_collider(scene_memory, world->objects, world->objects_count, COLLIDER_BVH);
+    hittable *tagged_collider  = make_collider(scene_memory, world->objects, world->objects_count, COLLIDER_PRIMITIVES);
+
+    f64 virtual_rate = closestHitRate(world, virtual_collider);
+    f64 tagged_rate  = closestHitRate(world, tagged_collider);
+    f64 virtual_seconds = renderSeconds(world, virtual_collider, virtual_image);
+    f64 tagged_seconds  = renderSeconds(world, tagged_collider, tagged_image);
+
+    i32 max_diff = 0;
+    for (i32 k = 0; k < pixels_count * 4; k++) max_diff = MAX(max_diff, abs(virtual_image[k] - tagged_image[k]));
+    printf("%16s %18.0f %18.0f %9.2fx %14.3f %14.3f %9.2fx %10d\n", scene, virtual_rate, tagged_rate,
+           tagged_rate / virtual_rate, virtual_seconds, tagged_seconds, virtual_seconds / tagged_seconds, max_diff);
+  }
+
+  free(virtual_image);
+  free(tagged_image);
+  return 0;
+}
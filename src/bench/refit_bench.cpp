@@ -0,0 +1,80 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "bench_utils.h"
+
+// Keeping the collider of an animated sphere field up to date: built again
+// every frame with the SAH or the LBVH, refit only, or refit with the
+// subtrees that degraded rebuilt. Average update time, SAH cost and closest
+// hit throughput of primary rays after the last frame.
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 180
+#define BENCH_FRAMES 24
+#define BENCH_FPS    24.0f
+
+int main() {
+  const u32 sizes[] = {100000, 1000000};
+  f32 aspect_ratio  = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+
+  struct Strategy {
+    const char *name;
+    bool rebuild;
+    BvhBuildSettings build;
+    BvhRefitSettings refit;
+  } strategies[4];
+  strategies[0].name    = "rebuild sah";
+  strategies[0].rebuild = true;
+  strategies[0].build   = default_bvh_build_settings();
+  strategies[1].name    = "rebuild lbvh";
+  strategies[1].rebuild = true;
+  strategies[1].build   = default_bvh_build_settings();
+  strategies[1].build.builder = BVH_BUILDER_LBVH;
+  strategies[2].name    = "refit";
+  strategies[2].rebuild = false;
+  strategies[2].refit   = default_bvh_refit_settings();
+  strategies[2].refit.degradation = 0;
+  strategies[3].name    = "refit + subtrees";
+  strategies[3].rebuild = false;
+  strategies[3].refit   = default_bvh_refit_settings();
+
+  printf("Refit workers: %u, %u frames at %.0f fps\n", lbvh_threads(0, 1u << 30), BENCH_FRAMES, BENCH_FPS);
+  for (u32 size : sizes) {
+    printf("\n%u spheres\n", size);
+    printf("%-18s %12s %12s %10s %16s\n", "update", "avg (ms)", "rebuilt", "sah cost", "rays/s");
+    for (const Strategy &strategy : strategies) {
+      randState scene_state(970);
+      arena scene_memory;
+      World *world = sphere_field_world(scene_memory, aspect_ratio, size, &scene_state, COLLIDER_PRIMITIVES);
+      vec3 *rest   = sphere_rest_centers(scene_memory, world);
+
+      // Rebuilt colliders go to a frame arena, the world arena keeps the refit one
+      arena frame_memory;
+      primitive_bvh *collider = (primitive_bvh *) world->collider;
+      f64 update_seconds = 0;
+      u32 rebuilt = 0, full_rebuilds = 0;
+      for (u32 frame = 1; frame <= BENCH_FRAMES; frame++) {
+        move_spheres(world, rest, frame / BENCH_FPS);
+        auto start = std::chrono::steady_clock::now();
+        if (strategy.rebuild) {
+          frame_memory.reset();
+          collider = (primitive_bvh *) make_collider(frame_memory, world->objects, world->objects_count,
+                                                     COLLIDER_PRIMITIVES, &strategy.build);
+        } else {
+          BvhRefitStats stats = collider->refit(scene_memory, world->objects, &strategy.refit);
+          rebuilt       += stats.rebuilt;
+          full_rebuilds += stats.full_rebuild;
+        }
+        update_seconds += elapsedSeconds(start);
+      }
+
+      randState trace_state(1);
+      f64 rate = traceRays(world, collider, BENCH_WIDTH * BENCH_HEIGHT * 4, BENCH_WIDTH, BENCH_HEIGHT, &trace_state);
+      char rebuilt_text[32] = "-";
+      if (!strategy.rebuild) snprintf(rebuilt_text, sizeof(rebuilt_text), "%u + %u", rebuilt, full_rebuilds);
+      printf("%-18s %12.1f %12s %10.2f %16.0f\n", strategy.name, 1000.0 * update_seconds / BENCH_FRAMES, rebuilt_text,
+             collider->tree.sah_cost(), rate);
+    }
+  }
+  return 0;
+}
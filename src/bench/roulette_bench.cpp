@@ -0,0 +1,92 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Russian roulette against paths that always run to ray_max_depth: rays per
+// path, render time and RMSE at a fixed sample count for several roulette
+// depths, on book_cover_world and the mesh world. RMSE falls as 1 / sqrt(time),
+// so the time to reach the RMSE of the run without roulette is
+// time * (rmse / rmse_off)^2. The mean column is the average displayed value
+// minus the reference one, roulette keeps it unbiased.
+
+#define BENCH_WIDTH       160
+#define BENCH_HEIGHT      90
+#define BENCH_SAMPLES     64
+#define REFERENCE_SAMPLES 512
+#define BENCH_RUNS        3
+
+f64 imageMeanDifference(const u8* a, const u8* b, i32 pixels_count){
+  f64 sum = 0;
+  for (i32 p = 0; p < pixels_count; p++) {
+    for (i32 c = 0; c < 3; c++) sum += (a[4*p + c] - b[4*p + c]) / 255.0;
+  }
+  return sum / (3.0 * pixels_count);
+}
+
+int main() {
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+  const char* scenes[] = {"book", "mesh"};
+  const i32 roulette_depths[] = {0, 1, 3, 5};
+
+  u8 *reference    = (u8 *) malloc(pixels_count * 4);
+  u8 *texture_data = (u8 *) malloc(pixels_count * 4);
+
+  for (const char* scene : scenes) {
+    RenderSettings settings = default_render_settings();
+    randState scene_state(settings.seed);
+    arena scene_memory;
+    World *world = create_world(scene_memory, scene, aspect_ratio, &scene_state);
+
+    RenderSettings reference_settings = settings;
+    reference_settings.seed    = settings.seed + 1;
+    reference_settings.sampler = SAMPLER_SOBOL;
+    world->pixel_samples       = REFERENCE_SAMPLES;
+    world->roulette_depth      = 0;
+    fullRayTrace(reference, BENCH_WIDTH, BENCH_HEIGHT, world, &reference_settings);
+
+    printf("%s %dx%d, %d spp, depth %d, %u threads\n", scene, BENCH_WIDTH, BENCH_HEIGHT, BENCH_SAMPLES,
+           world->ray_max_depth, render_threads(&settings));
+    printf("%-10s %14s %10s %10s %10s %16s\n", "roulette", "rays/path", "time (s)", "rmse", "mean", "time to rmse");
+
+    f64 off_rmse = 0, off_seconds = 0;
+    for (i32 roulette_depth : roulette_depths) {
+      RenderStats stats;
+      stats.samples  = 0;
+      stats.rays     = 0;
+      settings.stats = &stats;
+      world->pixel_samples  = BENCH_SAMPLES;
+      world->roulette_depth = roulette_depth;
+
+      // Fastest of a few runs, the image and counters are the same every time
+      f64 seconds = INF;
+      for (i32 run = 0; run < BENCH_RUNS; run++) {
+        stats.samples = 0;
+        stats.rays    = 0;
+        auto start = std::chrono::steady_clock::now();
+        fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+        seconds = MIN(seconds, elapsedSeconds(start));
+      }
+      f64 rmse    = imageRMSE(texture_data, reference, pixels_count);
+      f64 mean    = imageMeanDifference(texture_data, reference, pixels_count);
+      if (roulette_depth == 0) {
+        off_rmse    = rmse;
+        off_seconds = seconds;
+      }
+      f64 equal_seconds = seconds * (rmse / off_rmse) * (rmse / off_rmse);
+
+      char name[16];
+      if (roulette_depth == 0) snprintf(name, sizeof(name), "off");
+      else                     snprintf(name, sizeof(name), "after %d", roulette_depth);
+      printf("%-10s %14.3f %10.3f %10.5f %+10.5f %9.3f (%.2fx)\n", name, (f64)stats.rays / stats.samples, seconds, rmse,
+             mean, equal_seconds, off_seconds / equal_seconds);
+    }
+    printf("\n");
+  }
+
+  free(reference);
+  free(texture_data);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Noise of each sampler on book_cover_world against samples per pixel. Noise
+// is the RMSE of the displayed image against a high sample reference with an
+// independent seed. The last table gives the samples each sampler needs to
+// match the noise of the independent sampler, interpolated in log-log.
+
+#define BENCH_WIDTH       160
+#define BENCH_HEIGHT      90
+#define REFERENCE_SAMPLES 2048
+#define MAX_SAMPLES       256
+
+static const char* sampler_names[SAMPLER_TYPES] = {"independent", "sobol", "halton", "bluenoise"};
+
+int main() {
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+
+  RenderSettings settings = default_render_settings();
+  randState scene_state(settings.seed);
+  arena scene_memory;
+  World *world = book_cover_world(scene_memory, aspect_ratio, &scene_state);
+
+  u8 *reference    = (u8 *) malloc(pixels_count * 4);
+  u8 *texture_data = (u8 *) malloc(pixels_count * 4);
+
+  printf("Rendering %d spp reference...\n", REFERENCE_SAMPLES);
+  RenderSettings reference_settings = settings;
+  reference_settings.seed    = settings.seed + 1;
+  reference_settings.sampler = SAMPLER_SOBOL;
+  world->pixel_samples       = REFERENCE_SAMPLES;
+  fullRayTrace(reference, BENCH_WIDTH, BENCH_HEIGHT, world, &reference_settings);
+
+  const i32 levels = 9; // 1 to MAX_SAMPLES spp
+  f64 rmse[SAMPLER_TYPES][levels];
+  f64 seconds[SAMPLER_TYPES];
+
+  printf("\n%-8s", "spp");
+  for (u32 s = 0; s < SAMPLER_TYPES; s++) printf(" %12s", sampler_names[s]);
+  printf("\n");
+  for (u32 s = 0; s < SAMPLER_TYPES; s++) seconds[s] = 0;
+  for (i32 l = 0; l < levels; l++) {
+    i32 spp = 1 << l;
+    printf("%-8d", spp);
+    for (u32 s = 0; s < SAMPLER_TYPES; s++) {
+      settings.sampler     = (SamplerType)s;
+      world->pixel_samples = spp;
+      auto start = std::chrono::steady_clock::now();
+      fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+      seconds[s] += elapsedSeconds(start);
+      rmse[s][l]  = imageRMSE(texture_data, reference, pixels_count);
+      printf(" %12.5f", rmse[s][l]);
+    }
+    printf("\n");
+  }
+
+  printf("\nTime per sample (ns)");
+  for (u32 s = 0; s < SAMPLER_TYPES; s++) {
+    printf("  %s %.0f", sampler_names[s], 1e9 * seconds[s] / ((f64)pixels_count * ((1 << levels) - 1)));
+  }
+  printf("\n\nSamples per pixel to match the independent sampler\n");
+  printf("%-12s", "independent");
+  for (u32 s = 1; s < SAMPLER_TYPES; s++) printf(" %13s", sampler_names[s]);
+  printf("\n");
+  for (i32 l = 2; l < levels; l++) {
+    printf("%-12d", 1 << l);
+    for (u32 s = 1; s < SAMPLER_TYPES; s++) {
+      f64 spp = samplesForRMSE(rmse[s], levels, rmse[SAMPLER_INDEPENDENT][l]);
+      if (isnan(spp)) printf(" %13s", "-");
+      else            printf(" %6.1f (%3.0f%%)", spp, 100.0 * spp / (1 << l));
+    }
+    printf("\n");
+  }
+
+  free(reference);
+  free(texture_data);
+  return 0;
+}
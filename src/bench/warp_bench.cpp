@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include "../../ext/cycle_timer.h"
+#include "../raytracer/geometry/sample_batch.h"
+
+// Cost of the sample warps on one thread: random numbers drawn and cycles per
+// sample of the former rejection loops, the closed form scalar warps and their
+// batch versions on 8 and 16 lanes. The uniforms come from PCG32 in every
+// case, so the cycles include drawing them. The check column is a moment of
+// the distribution: E[r^2] is 1/2 on the disk, 3/5 in the ball and 1 on the
+// sphere, E[cos theta] of the normalized hemisphere direction is 2/3.
+
+#define BENCH_SAMPLES (1 << 22)
+
+// PCG32 that counts its draws
+struct counting_rng {
+  pcg32 rng;
+  u64 calls;
+  counting_rng() : rng(7), calls(0) {}
+  inline f32 next_f32() { calls++; return rng.next_f32(); }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Rejection sampling, as vec3.h did before the closed form warps
+
+inline vec3 rejection_vec3(counting_rng &g) {
+  f32 x = -1 + 2 * g.next_f32();
+  f32 y = -1 + 2 * g.next_f32();
+  f32 z = -1 + 2 * g.next_f32();
+  return vec3(x, y, z);
+}
+
+inline vec3 rejection_disk(counting_rng &g) {
+  while (true) {
+    vec3 v = rejection_vec3(g);
+    v.e[2] = 0.0f;
+    if (v.norm_squared() < 1) return v;
+  }
+}
+
+inline vec3 rejection_ball(counting_rng &g) {
+  while (true) {
+    vec3 v = rejection_vec3(g);
+    if (v.norm_squared() < 1) return v;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+
+typedef struct {
+  const char *name;
+  f64 calls;  // random numbers per sample
+  f64 cycles; // per sample
+  f64 check;
+} WarpResult;
+
+// Moment reported in the check column, for the normal (0, 0, 1) when hemisphere
+inline f64 warpMoment(vec3 v, bool hemisphere) {
+  return hemisphere ? v.z() / v.norm() : v.norm_squared();
+}
+
+template <typename Warp>
+WarpResult runScalar(const char *name, bool hemisphere, Warp warp) {
+  counting_rng g;
+  f64 sum = 0;
+  SysClock start = currentTicks();
+  for (u32 k = 0; k < BENCH_SAMPLES; k++) sum += warpMoment(warp(g), hemisphere);
+  SysClock end = currentTicks();
+  return {name, (f64)g.calls / BENCH_SAMPLES, (f64)(end - start) / BENCH_SAMPLES, sum / BENCH_SAMPLES};
+}
+
+// Batch warps take `dimensions` uniforms per sample and leave x, y, z
+template <u32 N, typename Warp>
+WarpResult runBatch(const char *name, bool hemisphere, u32 dimensions, Warp warp) {
+  counting_rng g;
+  f64 sum = 0;
+  alignas(64) f32 u[3][N], x[N], y[N], z[N];
+  SysClock start = currentTicks();
+  for (u32 k = 0; k < BENCH_SAMPLES; k += N) {
+    for (u32 lane = 0; lane < N; lane++) {
+      for (u32 d = 0; d < dimensions; d++) u[d][lane] = g.next_f32();
+    }
+    warp(u, x, y, z);
+    for (u32 lane = 0; lane < N; lane++) sum += warpMoment(vec3(x[lane], y[lane], z[lane]), hemisphere);
+  }
+  SysClock end = currentTicks();
+  return {name, (f64)g.calls / BENCH_SAMPLES, (f64)(end - start) / BENCH_SAMPLES, sum / BENCH_SAMPLES};
+}
+
+template <u32 N>
+void runBatches(WarpResult *results, u32 *count) {
+  results[(*count)++] = runBatch<N>(N == 8 ? "disk, batch 8" : "disk, batch 16", false, 2,
+    [](f32 (*u)[N], f32 *x, f32 *y, f32 *z) {
+      sample_unit_disk_batch<N>(u[0], u[1], x, y);
+      for (u32 k = 0; k < N; k++) z[k] = 0.0f;
+    });
+  results[(*count)++] = runBatch<N>(N == 8 ? "ball, batch 8" : "ball, batch 16", false, 3,
+    [](f32 (*u)[N], f32 *x, f32 *y, f32 *z) { sample_unit_ball_batch<N>(u[0], u[1], u[2], x, y, z); });
+  results[(*count)++] = runBatch<N>(N == 8 ? "sphere, batch 8" : "sphere, batch 16", false, 2,
+    [](f32 (*u)[N], f32 *x, f32 *y, f32 *z) { sample_unit_sphere_batch<N>(u[0], u[1], x, y, z); });
+  results[(*count)++] = runBatch<N>(N == 8 ? "hemisphere, batch 8" : "hemisphere, batch 16", true, 2,
+    [](f32 (*u)[N], f32 *x, f32 *y, f32 *z) {
+      for (u32 k = 0; k < N; k++) { x[k] = 0.0f; y[k] = 0.0f; z[k] = 1.0f; }
+      sample_cosine_hemisphere_batch<N>(u[0], u[1], x, y, z);
+    });
+}
+
+int main() {
+  const vec3 normal(0, 0, 1);
+  WarpResult results[32];
+  u32 count = 0;
+
+  results[count++] = runScalar("disk, rejection", false, [](counting_rng &g) { return rejection_disk(g); });
+  results[count++] = runScalar("disk, concentric", false, [](counting_rng &g) {
+    f32 u1 = g.next_f32();
+    f32 u2 = g.next_f32();
+    return sample_unit_disk(u1, u2);
+  });
+  results[count++] = runScalar("ball, rejection", false, [](counting_rng &g) { return rejection_ball(g); });
+  results[count++] = runScalar("ball, closed form", false, [](counting_rng &g) {
+    f32 u1 = g.next_f32();
+    f32 u2 = g.next_f32();
+    f32 u3 = g.next_f32();
+    return sample_unit_ball(u1, u2, u3);
+  });
+  results[count++] = runScalar("sphere, rejection", false, [](counting_rng &g) { return normalize(rejection_ball(g)); });
+  results[count++] = runScalar("sphere, closed form", false, [](counting_rng &g) {
+    f32 u1 = g.next_f32();
+    f32 u2 = g.next_f32();
+    return sample_unit_sphere(u1, u2);
+  });
+  // The former lambertian scatter: normal plus a point in the ball
+  results[count++] = runScalar("hemisphere, rejection", true, [&](counting_rng &g) { return normal + rejection_ball(g); });
+  results[count++] = runScalar("hemisphere, cosine", true, [&](counting_rng &g) {
+    f32 u1 = g.next_f32();
+    f32 u2 = g.next_f32();
+    return sample_cosine_hemisphere(normal, u1, u2);
+  });
+  runBatches<8>(results, &count);
+  runBatches<16>(results, &count);
+
+  printf("%d samples per warp, 1 thread\n", BENCH_SAMPLES);
+  printf("%-24s %14s %16s %10s\n", "warp", "rng calls", "cycles/sample", "check");
+  for (u32 k = 0; k < count; k++) {
+    printf("%-24s %14.3f %16.1f %10.4f\n", results[k].name, results[k].calls, results[k].cycles, results[k].check);
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "../raytracer/render.h"
+#include "bench_utils.h"
+
+// Path against wavefront integrator on the same images: wall time, ray
+// throughput and the largest 8 bit difference between the two renders (the
+// paths are the same, only floating point rounding may differ).
+
+#define BENCH_WIDTH  640
+#define BENCH_HEIGHT 360
+#define BENCH_SPP    8
+
+typedef struct {
+  f64 seconds;
+  u64 rays;
+} BenchResult;
+
+BenchResult renderIntegrator(World* world, RenderSettings settings, Integrator integrator, u8* texture_data){
+  RenderStats stats;
+  stats.samples       = 0;
+  stats.rays          = 0;
+  settings.stats      = &stats;
+  settings.integrator = integrator;
+
+  auto start = std::chrono::steady_clock::now();
+  fullRayTrace(texture_data, BENCH_WIDTH, BENCH_HEIGHT, world, &settings);
+  BenchResult result;
+  result.seconds = elapsedSeconds(start);
+  result.rays    = stats.rays;
+  return result;
+}
+
+int main() {
+  const char* scenes[] = {"simple", "book", "field:50000", "field:1000000", "mesh"};
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  i32 pixels_count = BENCH_WIDTH * BENCH_HEIGHT;
+  RenderSettings settings = default_render_settings();
+
+  u8 *path_image = (u8 *) malloc(pixels_count * 4);
+  u8 *wavefront_image = (u8 *) malloc(pixels_count * 4);
+
+  printf("%dx%d, %d spp, %u threads\n", BENCH_WIDTH, BENCH_HEIGHT, BENCH_SPP, render_threads(&settings));
+  printf("%16s %14s %14s %18s %18s %10s %10s\n", "scene", "path (s)", "wavefront (s)", "path (rays/s)",
+         "wavefront (rays/s)", "speedup", "max diff");
+  for (const char* scene : scenes) {
+    randState scene_state(settings.seed);
+    arena scene_memory;
+    World *world = create_world(scene_memory, scene, aspect_ratio, &scene_state);
+    world->pixel_samples = BENCH_SPP;
+
+    BenchResult path = renderIntegrator(world, settings, INTEGRATOR_PATH, path_image);
+    BenchResult wavefront = renderIntegrator(world, settings, INTEGRATOR_WAVEFRONT, wavefront_image);
+
+    i32 max_diff = 0;
+    for (i32 k = 0; k < pixels_count * 4; k++) max_diff = MAX(max_diff, abs(path_image[k] - wavefront_image[k]));
+    printf("%16s %14.3f %14.3f %18.0f %18.0f %9.2fx %10d\n", scene, path.seconds, wavefront.seconds,
+           path.rays / path.seconds, wavefront.rays / wavefront.seconds,
+           path.seconds / wavefront.seconds, max_diff);
+  }
+
+  free(path_image);
+  free(wavefront_image);
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "bench_utils.h"
+
+// Binary against 4 and 8 wide BVH traversal: closest hit throughput of
+// primary rays and of incoherent rays (random origins and directions inside
+// the scene) on book_cover_world, then of rays towards large tessellated
+// spheres hit through the mesh BVH. Mismatches count rays whose closest hit
+// differs from the binary tree.
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 180
+#define BENCH_RAYS   (BENCH_WIDTH * BENCH_HEIGHT * 4)
+
+// Primary rays through random pixel positions, or rays between two random
+// points of `bounds` when incoherent
+void makeRays(World* world, const aabb& bounds, bool incoherent, ray* rays, u32 rays_count){
+  randState random_state(1);
+  for (u32 k = 0; k < rays_count; k++) {
+    if (incoherent) {
+      vec3 extent = bounds.max - bounds.min;
+      vec3 a = bounds.min + vec3(RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state)) * extent;
+      vec3 b = bounds.min + vec3(RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state), RANDOM_UNIFORM(&random_state)) * extent;
+      rays[k] = ray(a, b - a);
+    } else {
+      u32 pixel = k % (BENCH_WIDTH * BENCH_HEIGHT);
+      f32 u     = f32(pixel % BENCH_WIDTH + RANDOM_UNIFORM(&random_state)) / f32(BENCH_WIDTH);
+      f32 v     = f32(pixel / BENCH_WIDTH + RANDOM_UNIFORM(&random_state)) / f32(BENCH_HEIGHT);
+      rays[k]   = world->camera->get_ray(u, v, &random_state);
+    }
+  }
+}
+
+f64 traceRays(const hittable* collider, const ray* rays, u32 rays_count, f32* hit_t){
+  auto start = std::chrono::steady_clock::now();
+  for (u32 k = 0; k < rays_count; k++) {
+    hit_record rec;
+    hit_t[k] = collider->hit(rays[k], rec) ? rec.t : INF;
+  }
+  return rays_count / elapsedSeconds(start);
+}
+
+// Rates every collider on the rays, the first one is the reference
+void compareColliders(const char* label, const char** names, const hittable** colliders, u32 colliders_count,
+                      const ray* rays, u32 rays_count){
+  f32 *reference_t = (f32 *) malloc(rays_count * sizeof(f32));
+  f32 *hit_t       = (f32 *) malloc(rays_count * sizeof(f32));
+  f64 reference_rate = traceRays(colliders[0], rays, rays_count, reference_t);
+  for (u32 c = 0; c < colliders_count; c++) {
+    f64 rate = c == 0 ? reference_rate : traceRays(colliders[c], rays, rays_count, hit_t);
+    u32 mismatches = 0;
+    for (u32 k = 0; c > 0 && k < rays_count; k++) mismatches += hit_t[k] != reference_t[k];
+    printf("%-22s %-10s %16.0f %9.2fx %10u\n", label, names[c], rate, rate / reference_rate, mismatches);
+  }
+  free(reference_t);
+  free(hit_t);
+}
+
+int main() {
+  f32 aspect_ratio = f32(BENCH_WIDTH) / f32(BENCH_HEIGHT);
+  ray *rays = (ray *) malloc(BENCH_RAYS * sizeof(ray));
+  printf("%-22s %-10s %16s %10s %10s\n", "rays", "bvh", "rays/s", "speedup", "mismatch");
+
+  {
+    randState scene_state(970);
+    arena scene_memory;
+    World *world = book_cover_world(scene_memory, aspect_ratio, &scene_state, COLLIDER_PRIMITIVES);
+    const char *names[] = {"binary", "wide 4", "wide 8"};
+    const hittable *colliders[] = {
+      world->collider,
+      make_collider(scene_memory, world->objects, world->objects_count, COLLIDER_WIDE4),
+      make_collider(scene_memory, world->objects, world->objects_count, COLLIDER_WIDE8),
+    };
+    // The ground sphere is huge, incoherent rays stay around the small spheres
+    aabb bounds(vec3(-12, 0, -12), vec3(12, 3, 12));
+    makeRays(world, bounds, false, rays, BENCH_RAYS);
+    compareColliders("book, primary", names, colliders, 3, rays, BENCH_RAYS);
+    makeRays(world, bounds, true, rays, BENCH_RAYS);
+    compareColliders("book, incoherent", names, colliders, 3, rays, BENCH_RAYS);
+  }
+
+  // One tessellated sphere seen by the camera of mesh_world, hit through its own BVH
+  const u32 resolutions[][2] = {{128, 256}, {512, 1024}};
+  for (const u32 *resolution : resolutions) {
+    randState scene_state(970);
+    arena scene_memory;
+    World *world = mesh_world(scene_memory, aspect_ratio, &scene_state, 1);
+    u32 *indices;
+    u32 triangles_count = uv_sphere_indices(scene_memory, resolution[0], resolution[1], &indices);
+    vec3 *normals       = uv_sphere_directions(scene_memory, resolution[0], resolution[1]);
+    u32 vertices_count  = (resolution[0] + 1) * (resolution[1] + 1);
+    vec3 *vertices      = scene_memory.array<vec3>(vertices_count);
+    // Ripples keep the surface from being a perfect convex shell
+    for (u32 k = 0; k < vertices_count; k++) {
+      vec3 n = normals[k];
+      vertices[k] = (0.9f + 0.05f * sinf(20 * n.x()) * sinf(20 * n.y()) * sinf(20 * n.z())) * n + vec3(0, 0.9f, 0);
+    }
+    triangle_mesh *mesh = scene_memory.create<triangle_mesh>(scene_memory, vertices, normals, indices, triangles_count, 0, false);
+    triangle_mesh *mesh4 = scene_memory.create<triangle_mesh>(*mesh);
+    triangle_mesh *mesh8 = scene_memory.create<triangle_mesh>(*mesh);
+    mesh4->widen(scene_memory, 4);
+    mesh8->widen(scene_memory, 8);
+
+    char label[64];
+    const char *names[] = {"binary", "wide 4", "wide 8"};
+    const hittable *colliders[] = {mesh, mesh4, mesh8};
+    aabb bounds(vec3(-1, 0, -1), vec3(1, 1.8f, 1));
+    makeRays(world, bounds, false, rays, BENCH_RAYS);
+    snprintf(label, sizeof(label), "%uk tris, primary", triangles_count / 1000);
+    compareColliders(label, names, colliders, 3, rays, BENCH_RAYS);
+    makeRays(world, bounds, true, rays, BENCH_RAYS);
+    snprintf(label, sizeof(label), "%uk tris, incoherent", triangles_count / 1000);
+    compareColliders(label, names, colliders, 3, rays, BENCH_RAYS);
+  }
+
+  free(rays);
+  return 0;
+}
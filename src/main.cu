@@ -13,6 +13,7 @@
 #include "raytracer/camera.h"
 
 #include "raytracer/worlds_cuda.cu"
+#include "raytracer/path.h"
 
 #include <curand_kernel.h>
 #include <time.h>
@@ -26,30 +27,11 @@ void inline check_cuda(cudaError_t error, const char* func, const char* filename
   }  
 }
 
-// Substitute recursion for a for loop to avoid stack overflow
-__device__ vec3 rayColor(const ray &r, World world, curandState *local_rand_state) {
-  ray cur_ray = r;
-  vec3 cur_attenuation = vec3(1.0, 1.0, 1.0);
-  
-  for (i32 i = 0; i < world.ray_max_depth; i++) {
-    hit_record rec;
-    if ((*(world.collider))->hit(cur_ray, 0.001f, INF, rec)) {
-      ray scattered;
-      vec3 attenuation;
-      if (rec.mat_ptr->scatter(cur_ray, rec, attenuation, scattered, local_rand_state)) {
-        cur_attenuation = cur_attenuation * attenuation;
-        cur_ray = scattered;
-      } else {
-        return vec3(0.0, 0.0, 0.0);
-      }
-    } else {
-      vec3 unit_direction = normalize(cur_ray.direction());
-      f32 t = 0.5f * (unit_direction.y() + 1.0f);
-      vec3 c = (1.0f - t) * world.sky_color1 + t * world.sky_color2;
-      return cur_attenuation * c;
-    }
-  }
-  return vec3(0.0, 0.0, 0.0); // exceeded recursion
+// Same iterative integrator as the CPU, path.h
+__device__ vec3 rayColor(const ray &r, u32 pixel_index, World world, curandState *local_rand_state) {
+  path_state path = path_start(r, pixel_index);
+  path_trace(path, world, *(world.collider), local_rand_state);
+  return path.radiance;
 }
 
 __global__ void rand_init(curandState *rand_state) {
@@ -79,8 +61,8 @@ __global__ void rayTrace(vec3 *fb, i32 width, i32 height, World world, curandSta
   for (i32 s = 0; s < world.pixel_samples; s++) {
     f32 u    = f32(i + curand_uniform(&local_rand_state)) / f32(width);
     f32 v    = f32(j + curand_uniform(&local_rand_state)) / f32(height);
-    ray r    = (*world.camera)->get_ray(u, v, &local_rand_state);
-    col      = col + rayColor(r, world, &local_rand_state);
+    ray r    = (*world.camera)->get_ray(u, v, &local_rand_state, pixel_index);
+    col      = col + rayColor(r, pixel_index, world, &local_rand_state);
   }
   
   rand_state[pixel_index] = local_rand_state;
@@ -102,6 +84,7 @@ i32 main() {
 
   i32 pixel_samples = 10;
   i32 ray_max_depth = 20; 
+  i32 roulette_depth = 5;
  
   WindowContext windowContext;
   windowContext.glfw_window = initWindowGLFW(width, height, title);
@@ -125,17 +108,19 @@ i32 main() {
   // make our world of hittables objects and the main camera 
   World world;
   checkCudaErrors(cudaMalloc((void **) &(world.objects), WORLD_SPACE * sizeof(hittable *)));  
+  checkCudaErrors(cudaMalloc((void **) &(world.materials), WORLD_SPACE * sizeof(material)));
   checkCudaErrors(cudaMalloc((void **) &(world.collider), sizeof(hittable *))); 
   checkCudaErrors(cudaMalloc((void **) &(world.camera), sizeof(Camera *))); 
   
-  // simple_world<<<1, 1>>>(world.objects, world.collider, world.camera, aspect_ratio);  
-  book_cover_world<<<1, 1>>>(world.objects, world.collider, world.camera, aspect_ratio, d_rand_state_world); 
+  // simple_world<<<1, 1>>>(world.objects, world.materials, world.collider, world.camera, aspect_ratio);  
+  book_cover_world<<<1, 1>>>(world.objects, world.materials, world.collider, world.camera, aspect_ratio, d_rand_state_world); 
   
   world.sky_color1     = vec3(1, 1, 1);
   world.sky_color2     = vec3(0.5, 0.7, 1.0);  
   
   world.pixel_samples  = pixel_samples;
   world.ray_max_depth  = ray_max_depth;
+  world.roulette_depth = roulette_depth;
   
   //------------------------------------
   // Prepare Render Texture and run RayTracing
@@ -189,6 +174,7 @@ i32 main() {
   checkCudaErrors(cudaFree(world.camera));
   checkCudaErrors(cudaFree(world.collider));
   checkCudaErrors(cudaFree(world.objects));
+  checkCudaErrors(cudaFree(world.materials));
   checkCudaErrors(cudaFree(d_rand_state_world));
   checkCudaErrors(cudaFree(d_rand_state_trace));
   checkCudaErrors(cudaFree(frame_buffer));
@@ -0,0 +1,347 @@
+#include <cstdlib>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/utils.h"
+
+#include "raytracer/camera.h"
+#include "raytracer/denoise.h"
+#include "raytracer/render.h"
+#include "raytracer/worlds.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../ext/stb_image_write.h"
+
+#include <chrono>
+
+// Batch renderer for machines without a display: no GLFW or OpenGL, the image
+// goes straight from the CPU texture to disk.
+
+// Fly-through of --frames: the camera turns around the scene while the small
+// spheres move, the collider is refit between frames
+#define ANIMATION_FPS   24.0f
+#define ANIMATION_ORBIT 0.25f // radians per second
+
+typedef struct {
+  i32 width;
+  i32 pixel_samples;
+  i32 ray_max_depth;
+  i32 roulette_depth;
+  i32 min_samples;
+  f32 noise_threshold;
+  bool huge_pages;
+  bool denoise;
+  u32 aovs; // AOV_BIT mask written to aov_output, 0 for none
+  i32 collider; // ColliderType, -1 keeps the default of the scene
+  bool rebuild;  // build the collider again with `build`
+  BvhBuildSettings build;
+  i32 frames;    // frames of the fly-through, 1 renders a still image
+  BvhRefitSettings refit;
+  const char* scene;
+  const char* output;
+  const char* aov_output;
+  RenderSettings settings;
+} HeadlessOptions;
+
+void printUsage(const char* program) {
+  printf("Usage: %s [options]\n", program);
+  printf("  --width N      image width, height follows a 16:9 aspect ratio (default 1200)\n");
+  printf("  --spp N        samples per pixel (default 10)\n");
+  printf("  --depth N      maximum ray depth (default 20)\n");
+  printf("  --roulette N   bounces before Russian roulette may end a path, 0 disables it (default 5)\n");
+  printf("  --adaptive E   stop sampling a pixel once its error is below E, --spp is the maximum (default off)\n");
+  printf("  --min-spp N    samples taken before a pixel may stop when adaptive (default 8)\n");
+  printf("  --scene NAME   simple | book | field:N | mesh | mesh:N | instances | instances:N (default book)\n");
+  printf("  --threads N    worker threads, 0 uses every hardware thread (default 0)\n");
+  printf("  --tile N       tile size in pixels (default %d)\n", DEFAULT_TILE_SIZE);
+  printf("  --integrator I path | wavefront (default path)\n");
+  printf("  --sampler S    independent | sobol | halton | bluenoise (default independent)\n");
+  printf("  --denoise B    1 filters the image with its albedo, normal and depth features before saving (default 0)\n");
+  printf("  --aovs LIST    comma separated channels saved as an EXR, or all: beauty, albedo, normal, depth,\n");
+  printf("                 samples, variance, time (default none)\n");
+  printf("  --aov-out FILE output exr for --aovs (default aovs.exr)\n");
+  printf("  --packets N    trace camera rays in packets of 4, 8 or 16 with the path integrator (default 0, off)\n");
+  printf("  --collider C   list | bvh | simd | primitives | wide4 | wide8, packets need primitives or wide\n");
+  printf("                 (default per scene)\n");
+  printf("  --builder B    sah | lbvh, how the collider BVH is built (default sah)\n");
+  printf("  --morton N     bits of the LBVH Morton codes, 30 or 63 (default 63)\n");
+  printf("  --treelets N   LBVH treelet optimization rounds (default 0)\n");
+  printf("  --frames N     fly-through of N frames with moving spheres, saved as OUT_0001.png... (default 1)\n");
+  printf("  --refit R      between frames the collider is refit and its subtrees whose SAH cost grew R times\n");
+  printf("                 rebuilt, 0 only refits (default %.1f)\n", default_bvh_refit_settings().degradation);
+  printf("  --seed N       scene and sampling seed (default 970)\n");
+  printf("  --huge-pages B 1 backs the scene arena with 2 MB pages (default 0)\n");
+  printf("  --out FILE     output png (default raytraced_image.png)\n");
+}
+
+// Comma separated channel names, or all
+bool parseAovs(const char* list, u32* mask) {
+  if (strcmp(list, "all") == 0) {
+    *mask = AOV_ALL;
+    return true;
+  }
+  char name[32];
+  *mask = 0;
+  while (*list) {
+    size_t length = strcspn(list, ",");
+    if (length >= sizeof(name)) return false;
+    memcpy(name, list, length);
+    name[length] = 0;
+    AovChannel channel = aov_channel(name);
+    if (channel == AOV_CHANNELS) return false;
+    *mask |= AOV_BIT(channel);
+    list += length + (list[length] == ',');
+  }
+  return *mask != 0;
+}
+
+bool parseOptions(i32 argc, char** argv, HeadlessOptions* options) {
+  options->width           = 1200;
+  options->pixel_samples   = 10;
+  options->ray_max_depth   = 20;
+  options->roulette_depth  = 5;
+  options->min_samples     = 8;
+  options->noise_threshold = 0;
+  options->huge_pages      = false;
+  options->denoise         = false;
+  options->aovs            = 0;
+  options->collider        = -1;
+  options->rebuild         = false;
+  options->build           = default_bvh_build_settings();
+  options->frames          = 1;
+  options->refit           = default_bvh_refit_settings();
+  options->scene           = "book";
+  options->output          = "raytraced_image.png";
+  options->aov_output      = "aovs.exr";
+  options->settings        = default_render_settings();
+
+  for (i32 k = 1; k < argc; k++) {
+    const char* arg   = argv[k];
+    const char* value = (k + 1 < argc) ? argv[k + 1] : NULL;
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) return false;
+    if (value == NULL) {
+      ERROR_RETURN(false, "Missing value for %s\n", arg);
+    }
+
+    if      (strcmp(arg, "--width") == 0)   options->width = atoi(value);
+    else if (strcmp(arg, "--spp") == 0)     options->pixel_samples = atoi(value);
+    else if (strcmp(arg, "--depth") == 0)   options->ray_max_depth = atoi(value);
+    else if (strcmp(arg, "--roulette") == 0) options->roulette_depth = atoi(value);
+    else if (strcmp(arg, "--adaptive") == 0) options->noise_threshold = atof(value);
+    else if (strcmp(arg, "--min-spp") == 0) options->min_samples = atoi(value);
+    else if (strcmp(arg, "--scene") == 0)   options->scene = value;
+    else if (strcmp(arg, "--threads") == 0) {
+      i32 threads = atoi(value);
+      if (threads < 0) {
+        ERROR_RETURN(false, "Threads must be 0 or more\n");
+      }
+      options->settings.threads = threads;
+    }
+    else if (strcmp(arg, "--tile") == 0)    options->settings.tile_size = atoi(value);
+    else if (strcmp(arg, "--seed") == 0)    options->settings.seed = (u32) strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--out") == 0)     options->output = value;
+    else if (strcmp(arg, "--huge-pages") == 0) options->huge_pages = atoi(value) != 0;
+    else if (strcmp(arg, "--denoise") == 0) options->denoise = atoi(value) != 0;
+    else if (strcmp(arg, "--aov-out") == 0) options->aov_output = value;
+    else if (strcmp(arg, "--aovs") == 0) {
+      if (!parseAovs(value, &options->aovs)) {
+        ERROR_RETURN(false, "Unknown aov list %s\n", value);
+      }
+    }
+    else if (strcmp(arg, "--packets") == 0) options->settings.packet_size = atoi(value);
+    else if (strcmp(arg, "--morton") == 0)   options->build.morton_bits = atoi(value);
+    else if (strcmp(arg, "--treelets") == 0) options->build.treelet_rounds = atoi(value);
+    else if (strcmp(arg, "--frames") == 0)   options->frames = atoi(value);
+    else if (strcmp(arg, "--refit") == 0)    options->refit.degradation = atof(value);
+    else if (strcmp(arg, "--builder") == 0) {
+      if      (strcmp(value, "sah") == 0)  options->build.builder = BVH_BUILDER_SAH;
+      else if (strcmp(value, "lbvh") == 0) options->build.builder = BVH_BUILDER_LBVH;
+      else {
+        ERROR_RETURN(false, "Unknown builder %s\n", value);
+      }
+      options->rebuild = true;
+    }
+    else if (strcmp(arg, "--collider") == 0) {
+      if      (strcmp(value, "list") == 0)       options->collider = COLLIDER_LIST;
+      else if (strcmp(value, "bvh") == 0)        options->collider = COLLIDER_BVH;
+      else if (strcmp(value, "simd") == 0)       options->collider = COLLIDER_BVH_SIMD;
+      else if (strcmp(value, "primitives") == 0) options->collider = COLLIDER_PRIMITIVES;
+      else if (strcmp(value, "wide4") == 0)      options->collider = COLLIDER_WIDE4;
+      else if (strcmp(value, "wide8") == 0)      options->collider = COLLIDER_WIDE8;
+      else {
+        ERROR_RETURN(false, "Unknown collider %s\n", value);
+      }
+    }
+    else if (strcmp(arg, "--integrator") == 0) {
+      if      (strcmp(value, "path") == 0 || strcmp(value, "recursive") == 0) options->settings.integrator = INTEGRATOR_PATH;
+      else if (strcmp(value, "wavefront") == 0) options->settings.integrator = INTEGRATOR_WAVEFRONT;
+      else {
+        ERROR_RETURN(false, "Unknown integrator %s\n", value);
+      }
+    }
+    else if (strcmp(arg, "--sampler") == 0) {
+      if      (strcmp(value, "independent") == 0) options->settings.sampler = SAMPLER_INDEPENDENT;
+      else if (strcmp(value, "sobol") == 0)       options->settings.sampler = SAMPLER_SOBOL;
+      else if (strcmp(value, "halton") == 0)      options->settings.sampler = SAMPLER_HALTON;
+      else if (strcmp(value, "bluenoise") == 0)   options->settings.sampler = SAMPLER_BLUE_NOISE;
+      else {
+        ERROR_RETURN(false, "Unknown sampler %s\n", value);
+      }
+    }
+    else {
+      ERROR_RETURN(false, "Unknown option %s\n", arg);
+    }
+    k++;
+  }
+
+  if (options->width < 1 || options->pixel_samples < 1 || options->ray_max_depth < 1 || options->settings.tile_size < 1) {
+    ERROR_RETURN(false, "Width, samples, depth and tile size must be positive\n");
+  }
+  if (options->roulette_depth < 0) {
+    ERROR_RETURN(false, "Roulette depth must be 0 or more\n");
+  }
+  if (options->frames < 1 || options->refit.degradation < 0) {
+    ERROR_RETURN(false, "Frames must be positive and refit 0 or more\n");
+  }
+  if (options->build.morton_bits != 30 && options->build.morton_bits != 63) {
+    ERROR_RETURN(false, "Morton codes must have 30 or 63 bits\n");
+  }
+  u32 packet_size = options->settings.packet_size;
+  if (packet_size != 0 && packet_size != 4 && packet_size != 8 && packet_size != 16) {
+    ERROR_RETURN(false, "Packet size must be 0, 4, 8 or 16\n");
+  }
+  return true;
+}
+
+// path_0001.png for the frames of a fly-through, the path itself for a still image
+void framePath(const char* path, i32 frame, i32 frames, char* out, size_t size){
+  if (frames == 1) {
+    snprintf(out, size, "%s", path);
+    return;
+  }
+  const char *dot = strrchr(path, '.');
+  i32 stem = dot ? (i32)(dot - path) : (i32)strlen(path);
+  snprintf(out, size, "%.*s_%04d%s", stem, path, frame, dot ? dot : "");
+}
+
+int main(int argc, char** argv) {
+  HeadlessOptions options;
+  if (!parseOptions(argc, argv, &options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  f32 aspect_ratio  = 16.0 / 9.0;
+  i32 width         = options.width;
+  i32 height        = (i32)(width / aspect_ratio);
+  height = (height < 1) ? 1 : height;
+
+  //------------------------------------
+  // World + Camera + Materials
+  //------------------------------------
+  // Everything the scene allocates lives in the arena and goes away with it
+  arena scene_memory(ARENA_CHUNK_SIZE, options.huge_pages);
+  randState world_state(options.settings.seed);
+  auto build_start = std::chrono::steady_clock::now();
+  World *world = create_world(scene_memory, options.scene, aspect_ratio, &world_state);
+  if (world == NULL) {
+    fprintf(stderr, "Unknown scene %s\n", options.scene);
+    return 1;
+  }
+  if (options.collider >= 0 || options.rebuild) {
+    if (options.collider >= 0) world->collider_type = (ColliderType) options.collider;
+    options.build.threads = options.settings.threads;
+    auto collider_start = std::chrono::steady_clock::now();
+    world->collider = make_collider(scene_memory, world->objects, world->objects_count, world->collider_type, &options.build);
+    if (world->collider == NULL) {
+      fprintf(stderr, "Scene %s has objects the collider can not store\n", options.scene);
+      return 1;
+    }
+    f64 collider_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - collider_start).count();
+    printf("Built the collider in %.1f ms\n", 1000.0 * collider_seconds);
+  }
+  f64 build_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - build_start).count();
+  printf("Built %s in %f s, %.1f MB in the scene arena\n", options.scene, build_seconds, scene_memory.used / 1048576.0);
+  world->pixel_samples = options.pixel_samples;
+  world->ray_max_depth = options.ray_max_depth;
+  world->roulette_depth = options.roulette_depth;
+  world->adaptive_min_samples = options.min_samples;
+  world->noise_threshold      = options.noise_threshold;
+
+  RenderStats stats;
+  options.settings.stats = &stats;
+
+  //------------------------------------
+  // Render and save straight from the CPU texture
+  //------------------------------------
+  u8 *texture_data = (u8 *) malloc(width * height * 4);
+  // The denoiser reads its features from the same channels that are saved
+  u32 aov_mask = options.aovs | (options.denoise ? AOV_FEATURES : 0);
+  framebuffer *aovs = aov_mask ? new framebuffer(width, height, aov_mask) : NULL;
+  options.settings.aovs = aovs;
+
+  // Sphere centers the animation moves around, every frame updates the
+  // collider from the new positions
+  vec3 *rest_centers = options.frames > 1 ? sphere_rest_centers(scene_memory, world) : NULL;
+  options.refit.threads = options.settings.threads;
+  bool saved = true, aovs_saved = true;
+  for (i32 frame = 1; frame <= options.frames; frame++) {
+    if (options.frames > 1) {
+      if (frame > 1) world->camera->orbit(ANIMATION_ORBIT / ANIMATION_FPS);
+      move_spheres(world, rest_centers, (frame - 1) / ANIMATION_FPS);
+      auto update_start = std::chrono::steady_clock::now();
+      BvhRefitStats refit = update_collider(world, &options.refit);
+      f64 update_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - update_start).count();
+      printf("Frame %d: updated the collider in %.1f ms, ", frame, 1000.0 * update_seconds);
+      if (refit.subtrees == 0) printf("nothing to refit\n");
+      else printf("%u of %u subtrees rebuilt%s\n", refit.rebuilt, refit.subtrees, refit.full_rebuild ? ", then the whole tree" : "");
+    }
+    options.settings.frame = frame - 1;
+    stats.samples = 0;
+    stats.rays    = 0;
+    memset(texture_data, 0, width * height * 4);
+
+    printf("Rendering %s: %dx%d, %d samples per pixel, depth %d, %u threads\n", options.scene, width, height,
+           world->pixel_samples, world->ray_max_depth, render_threads(&options.settings));
+    auto start = std::chrono::steady_clock::now();
+    fullRayTrace(texture_data, width, height, world, &options.settings);
+    f64 timer_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    printf("Took %f s\n", timer_seconds);
+
+    u64 fixed_samples = (u64)width * height * world->pixel_samples;
+    printf("Samples: %llu of %llu (%.1f%% saved, %.2f per pixel)\n", (unsigned long long)stats.samples.load(),
+           (unsigned long long)fixed_samples, 100.0 * (1.0 - (f64)stats.samples / fixed_samples), (f64)stats.samples / (width * height));
+    printf("Rays per path: %.2f\n", (f64)stats.rays / stats.samples);
+
+    if (options.denoise) {
+      denoiser filter(width, height);
+      DenoiseSettings denoise_settings = default_denoise_settings();
+      auto denoise_start = std::chrono::steady_clock::now();
+      filter.run(texture_data, aovs, &denoise_settings, render_threads(&options.settings));
+      f64 denoise_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - denoise_start).count();
+      printf("Denoised in %.1f ms\n", 1000.0 * denoise_seconds);
+    }
+
+    // The beauty channel is the linear radiance before denoising
+    char path[1024];
+    if (options.aovs) {
+      framePath(options.aov_output, frame, options.frames, path, sizeof(path));
+      bool frame_saved = aovs->save_exr(path);
+      if (frame_saved) printf("Saved aovs to %s\n", path);
+      else fprintf(stderr, "Failed to save aovs to %s\n", path);
+      aovs_saved = aovs_saved && frame_saved;
+    }
+
+    // Row 0 is the bottom of the image, same layout as the OpenGL texture
+    stbi_flip_vertically_on_write(1);
+    framePath(options.output, frame, options.frames, path, sizeof(path));
+    i32 frame_saved = stbi_write_png(path, width, height, 4, texture_data, width * 4);
+    if (frame_saved) printf("Saved render to %s\n", path);
+    else fprintf(stderr, "Failed to save render to %s\n", path);
+    saved = saved && frame_saved;
+  }
+  delete aovs;
+
+  free(texture_data);
+  return saved && aovs_saved ? 0 : 1;
+}
@@ -2,6 +2,7 @@
 #define CAMERAH
 
 #include "geometry/ray.h"
+#include "geometry/transform.h"
 
 class Camera {
 public:
@@ -27,11 +28,23 @@ public:
     vertical = 2.0f * half_height * focus_dist * v;
   }
 
-  DEVICE ray get_ray(f32 s, f32 t, randState *local_rand_state) {
+  // Turns the camera around the vertical axis through the world origin
+  DEVICE void orbit(f32 radians) {
+    transform turn    = transform::rotation(vec3(0, 1, 0), radians);
+    origin            = turn.point(origin);
+    lower_left_corner = turn.point(lower_left_corner);
+    horizontal        = turn.vector(horizontal);
+    vertical          = turn.vector(vertical);
+    u                 = turn.vector(u);
+    v                 = turn.vector(v);
+    w                 = turn.vector(w);
+  }
+
+  DEVICE ray get_ray(f32 s, f32 t, randState *local_rand_state, u32 id = RAY_ID_NONE) {
     vec3 rd = lens_radius * random_in_unit_disk(local_rand_state);
     vec3 offset = u * rd.x() + v * rd.y();
     return ray(origin + offset, lower_left_corner + s * horizontal +
-                                    t * vertical - origin - offset);
+                                    t * vertical - origin - offset, id);
   }
 };
 
@@ -0,0 +1,263 @@
+#ifndef DENOISEH
+#define DENOISEH
+
+#include "render.h"
+
+//--------------------------------------------------------------------------------------------------
+// Edge Aware Denoiser
+// A few samples per pixel leave the lighting noisy while the first hit
+// features are almost clean. The color is divided by the albedo so textures
+// are not blurred, then filtered by an a-trous wavelet: each pass is a 5x5
+// B3 spline kernel whose taps are spaced 2^k pixels apart, so n passes cover
+// 2^(n+2) - 3 pixels square for 25 taps each. Every tap is also weighted
+// like a joint bilateral filter, by how close its normal, depth and luminance
+// are to the center pixel. The luminance is allowed to differ by a few standard
+// deviations of the noise, estimated from the sample variance of the pixel and
+// filtered alongside the color, so converged pixels are barely touched.
+// Passes run on the tile workers and each row is filtered tap by tap over
+// planar arrays, so the weights are computed on a full vector of pixels.
+
+// Weight of a tap normal is max(0, n.n')^8, computed by 3 squarings. Higher
+// powers stop the filter on the small spheres of book_cover_world, where the
+// normal turns by several degrees per pixel.
+#define DENOISE_NORMAL_SQUARINGS 3
+// Albedo floor when dividing the color by it
+#define DENOISE_ALBEDO_EPSILON 1e-3f
+// Wider than the render tiles: rows are filtered a vector of pixels at a
+// time, longer rows spend less in loop prologues and epilogues
+#define DENOISE_TILE_SIZE 128
+
+typedef struct DenoiseSettings {
+  i32 iterations;      // a-trous passes, pass k spaces its taps 2^k pixels apart. Without
+                       // frames to accumulate over, more than 2 or 3 blur the lighting.
+  f32 sigma_luminance; // luminance difference allowed, in standard deviations of the noise
+  f32 sigma_depth;     // relative depth difference allowed per pixel of distance
+} DenoiseSettings;
+
+inline DenoiseSettings default_denoise_settings(){
+  DenoiseSettings settings;
+  settings.iterations      = 2;
+  settings.sigma_luminance = 4.0f;
+  settings.sigma_depth     = 0.05f;
+  return settings;
+}
+
+// e^-x for x >= 0 to about 3e-5, written so the tap loops vectorize: x is
+// clamped on its bits (same order as the values for positive floats), 2^-t is
+// split into 2^n added to the exponent bits times a Taylor polynomial of 2^f
+// for f in (-1, 0]. floorf and float compares would keep GCC from vectorizing.
+inline f32 denoiseExp(f32 x) {
+  i32 x_bits, max_bits;
+  f32 max_x = 87.0f;
+  memcpy(&x_bits, &x, sizeof(x_bits));
+  memcpy(&max_bits, &max_x, sizeof(max_bits));
+  x_bits = MIN(x_bits, max_bits);
+  memcpy(&x, &x_bits, sizeof(x));
+
+  f32 t = -x * 1.44269504f;
+  i32 n = (i32)t;
+  f32 f = t - (f32)n;
+  f32 p = 1.0f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f + f * (0.00961813f + f * (0.00133336f + f * 0.00015404f)))));
+  i32 bits;
+  memcpy(&bits, &p, sizeof(bits));
+  bits += n * (1 << 23);
+  memcpy(&p, &bits, sizeof(p));
+  return p;
+}
+
+// Adds one tap to the sums of a run of count center pixels: arrays named p_
+// are read at the center pixels, q_ at their taps and the rest per center
+inline void denoiseTap(i32 count, f32 kernel, f32 depth_scale,
+                       const f32 *__restrict p_lum, const f32 *__restrict p_nx, const f32 *__restrict p_ny,
+                       const f32 *__restrict p_nz, const f32 *__restrict p_depth,
+                       const f32 *__restrict q_r, const f32 *__restrict q_g, const f32 *__restrict q_b,
+                       const f32 *__restrict q_lum, const f32 *__restrict q_var, const f32 *__restrict q_nx,
+                       const f32 *__restrict q_ny, const f32 *__restrict q_nz, const f32 *__restrict q_depth,
+                       const f32 *__restrict inv_lum, f32 *__restrict sum_r, f32 *__restrict sum_g,
+                       f32 *__restrict sum_b, f32 *__restrict sum_w, f32 *__restrict sum_var) {
+  for (i32 x = 0; x < count; x++) {
+    f32 n = MAX(0.0f, p_nx[x] * q_nx[x] + p_ny[x] * q_ny[x] + p_nz[x] * q_nz[x]);
+    for (i32 k = 0; k < DENOISE_NORMAL_SQUARINGS; k++) n = n * n;
+    f32 luminance_distance = fabsf(q_lum[x] - p_lum[x]) * inv_lum[x];
+    f32 depth_distance     = fabsf(q_depth[x] - p_depth[x]) / (depth_scale * MIN(p_depth[x], q_depth[x]) + 1e-4f);
+    f32 w = kernel * n * denoiseExp(luminance_distance + depth_distance);
+    sum_r[x]   += w * q_r[x];
+    sum_g[x]   += w * q_g[x];
+    sum_b[x]   += w * q_b[x];
+    sum_w[x]   += w;
+    sum_var[x] += w * w * q_var[x];
+  }
+}
+
+class denoiser {
+public:
+  i32 width;
+  i32 height;
+  // Ping-pong planes of the demodulated color, its luminance and variance
+  f32 *color_r[2], *color_g[2], *color_b[2];
+  f32 *lum[2];
+  f32 *variance[2];
+
+  denoiser(i32 w, i32 h) : width(w), height(h) {
+    for (i32 k = 0; k < 2; k++) {
+      f32 **planes[] = {&color_r[k], &color_g[k], &color_b[k], &lum[k], &variance[k]};
+      for (f32 **plane : planes) *plane = (f32 *) malloc(sizeof(f32) * width * height);
+    }
+  }
+
+  ~denoiser() {
+    for (i32 k = 0; k < 2; k++) {
+      f32 *planes[] = {color_r[k], color_g[k], color_b[k], lum[k], variance[k]};
+      for (f32 *plane : planes) free(plane);
+    }
+  }
+
+  // Filters the beauty of features, which keeps the AOV_FEATURES channels, on
+  // threads workers and writes it gamma corrected to texture_data
+  void run(u8 *texture_data, const framebuffer *features, const DenoiseSettings *denoise, u32 threads) {
+    run_tiles(width, height, DENOISE_TILE_SIZE, threads, [&](u32, const Tile& tile) {
+      demodulate(features, tile);
+    });
+    i32 current = 0;
+    for (i32 k = 0; k < denoise->iterations; k++) {
+      run_tiles(width, height, DENOISE_TILE_SIZE, threads, [&](u32, const Tile& tile) {
+        filter(features, denoise, 1 << k, current, tile);
+      });
+      current = 1 - current;
+    }
+    run_tiles(width, height, DENOISE_TILE_SIZE, threads, [&](u32, const Tile& tile) {
+      remodulate(texture_data, features, current, tile);
+    });
+  }
+
+private:
+  inline vec3 albedo(const framebuffer *features, i32 p) const {
+    return vec3(MAX(features->plane(AOV_ALBEDO, 0)[p], DENOISE_ALBEDO_EPSILON), MAX(features->plane(AOV_ALBEDO, 1)[p], DENOISE_ALBEDO_EPSILON),
+                MAX(features->plane(AOV_ALBEDO, 2)[p], DENOISE_ALBEDO_EPSILON));
+  }
+
+  inline vec3 irradiance(const framebuffer *features, i32 p) const {
+    return vec3(features->plane(AOV_BEAUTY, 0)[p], features->plane(AOV_BEAUTY, 1)[p], features->plane(AOV_BEAUTY, 2)[p]) / albedo(features, p);
+  }
+
+  // Color divided by albedo into planes 0. The variance follows the luminance
+  // of the albedo, pixels with a single sample use the variance of their 3x3
+  // neighbourhood instead.
+  void demodulate(const framebuffer *features, const Tile &tile) {
+    for (i32 j = tile.y0; j < tile.y1; j++) {
+      for (i32 i = tile.x0; i < tile.x1; i++) {
+        i32 p = j * width + i;
+        vec3 col = irradiance(features, p);
+        color_r[0][p] = col.x();
+        color_g[0][p] = col.y();
+        color_b[0][p] = col.z();
+        lum[0][p]     = luminance(col);
+
+        f32 pixel_variance = features->plane(AOV_VARIANCE)[p];
+        if (pixel_variance < 0) {
+          f32 mean = 0, m2 = 0;
+          i32 n = 0;
+          for (i32 y = MAX(0, j - 1); y <= MIN(height - 1, j + 1); y++) {
+            for (i32 x = MAX(0, i - 1); x <= MIN(width - 1, i + 1); x++) {
+              f32 l     = luminance(irradiance(features, y * width + x));
+              f32 delta = l - mean;
+              mean     += delta / ++n;
+              m2       += delta * (l - mean);
+            }
+          }
+          variance[0][p] = m2 / MAX(n - 1, 1);
+        } else {
+          f32 a = luminance(albedo(features, p));
+          variance[0][p] = pixel_variance / (a * a);
+        }
+      }
+    }
+  }
+
+  // One a-trous pass reading planes current and writing the other ones
+  void filter(const framebuffer *features, const DenoiseSettings *denoise, i32 step, i32 current, const Tile &tile) {
+    static const f32 kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    const i32 next = 1 - current;
+    const f32 *in_r = color_r[current], *in_g = color_g[current], *in_b = color_b[current];
+    const f32 *in_lum = lum[current], *in_var = variance[current];
+    const f32 *normal_x = features->plane(AOV_NORMAL, 0), *normal_y = features->plane(AOV_NORMAL, 1);
+    const f32 *normal_z = features->plane(AOV_NORMAL, 2), *depth = features->plane(AOV_DEPTH);
+
+    i32 count = tile.x1 - tile.x0;
+    f32 *scratch = (f32 *) malloc(sizeof(f32) * (7 * count + 2));
+    f32 *inv_lum = scratch;
+    f32 *sum_r = scratch + count, *sum_g = scratch + 2 * count, *sum_b = scratch + 3 * count;
+    f32 *sum_w = scratch + 4 * count, *sum_var = scratch + 5 * count;
+    f32 *column_var = scratch + 6 * count; // count + 2 entries, from x0 - 1 to x1
+
+    for (i32 j = tile.y0; j < tile.y1; j++) {
+      const i32 row = j * width;
+      // The luminance stopping function uses the 3x3 blurred variance so one
+      // unlucky estimate does not stop the filter, blurred by columns then rows
+      const f32 *above = in_var + MAX(j - 1, 0) * width;
+      const f32 *below = in_var + MIN(j + 1, height - 1) * width;
+      for (i32 k = 0; k < count + 2; k++) {
+        i32 x = MIN(MAX(tile.x0 - 1 + k, 0), width - 1);
+        column_var[k] = 0.25f * above[x] + 0.5f * in_var[row + x] + 0.25f * below[x];
+      }
+      const f32 w = kernel[2] * kernel[2];
+      for (i32 k = 0; k < count; k++) {
+        f32 blurred = 0.25f * column_var[k] + 0.5f * column_var[k + 1] + 0.25f * column_var[k + 2];
+        inv_lum[k] = 1.0f / (denoise->sigma_luminance * sqrtf(MAX(blurred, 0.0f)) + 1e-4f);
+        i32 p      = row + tile.x0 + k;
+        sum_r[k]   = w * in_r[p];
+        sum_g[k]   = w * in_g[p];
+        sum_b[k]   = w * in_b[p];
+        sum_w[k]   = w;
+        sum_var[k] = w * w * in_var[p];
+      }
+
+      for (i32 b = -2; b <= 2; b++) {
+        i32 y = j + b * step;
+        if (y < 0 || y >= height) continue;
+        for (i32 a = -2; a <= 2; a++) {
+          if (a == 0 && b == 0) continue;
+          // Centers whose tap falls inside the image
+          i32 dx = a * step;
+          i32 x0 = MAX(tile.x0, -dx);
+          i32 x1 = MIN(tile.x1, width - dx);
+          if (x0 >= x1) continue;
+          i32 p = j * width + x0;
+          i32 q = y * width + x0 + dx;
+          i32 k = x0 - tile.x0;
+          f32 depth_scale = denoise->sigma_depth * step * sqrt(f32(a * a + b * b));
+          denoiseTap(x1 - x0, kernel[a + 2] * kernel[b + 2], depth_scale,
+                     in_lum + p, normal_x + p, normal_y + p, normal_z + p, depth + p,
+                     in_r + q, in_g + q, in_b + q, in_lum + q, in_var + q,
+                     normal_x + q, normal_y + q, normal_z + q, depth + q,
+                     inv_lum + k, sum_r + k, sum_g + k, sum_b + k, sum_w + k, sum_var + k);
+        }
+      }
+
+      f32 *out_r = color_r[next] + row + tile.x0, *out_g = color_g[next] + row + tile.x0;
+      f32 *out_b = color_b[next] + row + tile.x0, *out_lum = lum[next] + row + tile.x0;
+      f32 *out_var = variance[next] + row + tile.x0;
+      for (i32 k = 0; k < count; k++) {
+        f32 inv    = 1.0f / sum_w[k];
+        out_r[k]   = sum_r[k] * inv;
+        out_g[k]   = sum_g[k] * inv;
+        out_b[k]   = sum_b[k] * inv;
+        out_lum[k] = 0.2126f * out_r[k] + 0.7152f * out_g[k] + 0.0722f * out_b[k];
+        out_var[k] = sum_var[k] * inv * inv;
+      }
+    }
+    free(scratch);
+  }
+
+  void remodulate(u8 *texture_data, const framebuffer *features, i32 current, const Tile &tile) {
+    for (i32 j = tile.y0; j < tile.y1; j++) {
+      for (i32 i = tile.x0; i < tile.x1; i++) {
+        i32 p = j * width + i;
+        vec3 col = vec3(color_r[current][p], color_g[current][p], color_b[current][p]) * albedo(features, p);
+        writeTexturePixel(texture_data, p, col);
+      }
+    }
+  }
+};
+
+#endif
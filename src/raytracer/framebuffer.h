@@ -0,0 +1,200 @@
+#ifndef FRAMEBUFFERH
+#define FRAMEBUFFERH
+
+#include <string.h>
+
+#include "geometry/vec3.h"
+#include "../utils/exr.h"
+
+// HDR accumulation buffer: running sum of linear radiance per pixel
+class accumulation_buffer {
+public:
+  i32 width;
+  i32 height;
+  f32 *rgb;    // 3 floats per pixel
+  u32 samples; // samples per pixel already summed
+
+  accumulation_buffer(i32 w, i32 h) : width(w), height(h), samples(0) {
+    rgb = (f32 *) malloc(sizeof(f32) * 3 * width * height);
+    clear();
+  }
+  ~accumulation_buffer() { free(rgb); }
+
+  void clear() {
+    memset(rgb, 0, sizeof(f32) * 3 * width * height);
+    samples = 0;
+  }
+
+  inline void add(i32 pixel_index, const vec3 &col) {
+    f32 *p = rgb + 3 * pixel_index;
+    p[0] += col.x();
+    p[1] += col.y();
+    p[2] += col.z();
+  }
+
+  inline vec3 average(i32 pixel_index) const {
+    const f32 *p = rgb + 3 * pixel_index;
+    f32 inv = samples > 0 ? 1.0f / samples : 0.0f;
+    return vec3(p[0] * inv, p[1] * inv, p[2] * inv);
+  }
+};
+
+inline f32 luminance(const vec3& col) {
+  return 0.2126f * col.x() + 0.7152f * col.y() + 0.0722f * col.z();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Arbitrary Output Variables
+// Besides the displayed texture the integrators can write named f32 channels
+// of the whole image: the linear color, what the camera rays hit first
+// (albedo, normal and depth of the surface), the samples taken, their
+// variance and the time spent per pixel. The denoiser is guided by the first
+// hits, and the channels are saved together for compositing.
+
+#define FEATURE_SKY_DEPTH 1e20f
+
+// First hit of one camera ray
+typedef struct FeatureSample {
+  vec3 albedo; // material albedo, the sky color on a miss
+  vec3 normal; // surface normal, towards the camera on a miss
+  f32 depth;   // distance along the ray, FEATURE_SKY_DEPTH on a miss
+} FeatureSample;
+
+// First hits summed over the samples of a pixel and the running luminance
+// mean and squared deviations of its samples (Welford)
+typedef struct PixelFeatures {
+  FeatureSample sum;
+  f32 mean, m2;
+  i32 samples;
+
+  inline void clear() {
+    sum.albedo = vec3(0, 0, 0);
+    sum.normal = vec3(0, 0, 0);
+    sum.depth  = 0;
+    mean = m2 = 0;
+    samples   = 0;
+  }
+
+  inline void add(const vec3 &col, const FeatureSample &first_hit) {
+    sum.albedo = sum.albedo + first_hit.albedo;
+    sum.normal = sum.normal + first_hit.normal;
+    sum.depth += first_hit.depth;
+    samples++;
+    f32 y     = luminance(col);
+    f32 delta = y - mean;
+    mean     += delta / samples;
+    m2       += delta * (y - mean);
+  }
+} PixelFeatures;
+
+typedef enum {
+  AOV_BEAUTY,   // linear mean radiance
+  AOV_ALBEDO,   // first hit, averaged over the samples
+  AOV_NORMAL,
+  AOV_DEPTH,
+  AOV_SAMPLES,  // samples taken, below pixel_samples when adaptive
+  AOV_VARIANCE, // luminance variance of the pixel mean, negative with a single sample
+  AOV_TIME,     // seconds spent tracing the pixel
+  AOV_CHANNELS
+} AovChannel;
+
+#define AOV_BIT(channel) (1u << (channel))
+#define AOV_ALL          (AOV_BIT(AOV_CHANNELS) - 1)
+// Channels read by the denoiser
+#define AOV_FEATURES     (AOV_BIT(AOV_BEAUTY) | AOV_BIT(AOV_ALBEDO) | AOV_BIT(AOV_NORMAL) | AOV_BIT(AOV_DEPTH) | AOV_BIT(AOV_VARIANCE))
+
+typedef struct AovInfo {
+  const char *name;
+  u32 components;
+  const char *component_names; // one letter per component
+} AovInfo;
+
+static const AovInfo aov_info[AOV_CHANNELS] = {
+  {"beauty", 3, "RGB"}, {"albedo", 3, "RGB"}, {"normal", 3, "XYZ"}, {"depth", 1, "Z"},
+  {"samples", 1, "Y"}, {"variance", 1, "Y"}, {"time", 1, "Y"},
+};
+
+// Channel called name, AOV_CHANNELS if there is none
+inline AovChannel aov_channel(const char *name) {
+  for (u32 c = 0; c < AOV_CHANNELS; c++) {
+    if (strcmp(aov_info[c].name, name) == 0) return (AovChannel) c;
+  }
+  return AOV_CHANNELS;
+}
+
+// Channels of the whole image in planar form, one f32 array per component,
+// so filters run over rows with contiguous loads. Only the channels in the
+// mask are allocated and written.
+class framebuffer {
+public:
+  i32 width;
+  i32 height;
+  u32 channels; // AOV_BIT mask
+  f32 *planes[AOV_CHANNELS][3];
+
+  framebuffer(i32 w, i32 h, u32 channel_mask) : width(w), height(h), channels(channel_mask) {
+    for (u32 c = 0; c < AOV_CHANNELS; c++) {
+      for (u32 k = 0; k < 3; k++) {
+        bool allocated = has((AovChannel) c) && k < aov_info[c].components;
+        planes[c][k] = allocated ? (f32 *) malloc(sizeof(f32) * width * height) : NULL;
+      }
+    }
+  }
+
+  ~framebuffer() {
+    for (u32 c = 0; c < AOV_CHANNELS; c++) {
+      for (u32 k = 0; k < 3; k++) free(planes[c][k]);
+    }
+  }
+
+  inline bool has(AovChannel channel) const { return (channels & AOV_BIT(channel)) != 0; }
+  inline bool has_all(u32 channel_mask) const { return (channels & channel_mask) == channel_mask; }
+  inline f32 *plane(AovChannel channel, u32 component = 0) const { return planes[channel][component]; }
+
+  // Stores the mean color, features and time of a pixel in the channels kept
+  inline void set(i32 pixel_index, const vec3 &col, const PixelFeatures &features, f32 seconds) {
+    f32 inv = 1.0f / features.samples;
+    set3(AOV_BEAUTY, pixel_index, col);
+    set3(AOV_ALBEDO, pixel_index, inv * features.sum.albedo);
+    if (has(AOV_NORMAL)) {
+      vec3 normal = features.sum.normal;
+      if (normal.norm_squared() > 0) normal = normalize(normal);
+      set3(AOV_NORMAL, pixel_index, normal);
+    }
+    if (has(AOV_DEPTH))   planes[AOV_DEPTH][0][pixel_index]   = inv * features.sum.depth;
+    if (has(AOV_SAMPLES)) planes[AOV_SAMPLES][0][pixel_index] = features.samples;
+    if (has(AOV_VARIANCE)) {
+      planes[AOV_VARIANCE][0][pixel_index] = features.samples > 1 ? features.m2 / (features.samples - 1) * inv : -1.0f;
+    }
+    if (has(AOV_TIME))    planes[AOV_TIME][0][pixel_index]    = seconds;
+  }
+
+  // Saves every channel kept in one EXR file: the beauty as the default
+  // R, G, B layer, the others as layers named after them
+  bool save_exr(const char *path) const {
+    ExrChannel channel_list[3 * AOV_CHANNELS];
+    char names[3 * AOV_CHANNELS][32];
+    u32 count = 0;
+    for (u32 c = 0; c < AOV_CHANNELS; c++) {
+      if (!has((AovChannel) c)) continue;
+      for (u32 k = 0; k < aov_info[c].components; k++) {
+        if (c == AOV_BEAUTY) snprintf(names[count], sizeof(names[count]), "%c", aov_info[c].component_names[k]);
+        else snprintf(names[count], sizeof(names[count]), "%s.%c", aov_info[c].name, aov_info[c].component_names[k]);
+        channel_list[count].name = names[count];
+        channel_list[count].data = planes[c][k];
+        count++;
+      }
+    }
+    return write_exr(path, width, height, channel_list, count);
+  }
+
+private:
+  inline void set3(AovChannel channel, i32 pixel_index, const vec3 &v) {
+    if (!has(channel)) return;
+    planes[channel][0][pixel_index] = v.x();
+    planes[channel][1][pixel_index] = v.y();
+    planes[channel][2][pixel_index] = v.z();
+  }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef AABBH
+#define AABBH
+
+#include "ray.h"
+
+// Axis aligned bounding box
+class aabb {
+public:
+  vec3 min;
+  vec3 max;
+
+  HOST DEVICE aabb() : min(INF, INF, INF), max(-INF, -INF, -INF) {}
+  HOST DEVICE aabb(const vec3 &a, const vec3 &b) : min(a), max(b) {}
+
+  HOST DEVICE inline void grow(const vec3 &p) {
+    for (int i = 0; i < 3; i++) {
+      min.e[i] = MIN(min.e[i], p.e[i]);
+      max.e[i] = MAX(max.e[i], p.e[i]);
+    }
+  }
+
+  HOST DEVICE inline void grow(const aabb &b) {
+    for (int i = 0; i < 3; i++) {
+      min.e[i] = MIN(min.e[i], b.min.e[i]);
+      max.e[i] = MAX(max.e[i], b.max.e[i]);
+    }
+  }
+
+  HOST DEVICE inline vec3 centroid() const { return 0.5f * (min + max); }
+  HOST DEVICE inline bool empty() const { return min.e[0] > max.e[0]; }
+
+  HOST DEVICE inline f32 surface_area() const {
+    if (empty()) return 0.0f;
+    vec3 d = max - min;
+    return 2.0f * (d.e[0] * d.e[1] + d.e[1] * d.e[2] + d.e[2] * d.e[0]);
+  }
+
+  // Slab test, inv_direction is 1 / ray direction
+  HOST DEVICE inline bool hit(const vec3 &origin, const vec3 &inv_direction,
+                              f32 t_min, f32 t_max, f32 &t_entry) const {
+    for (int i = 0; i < 3; i++) {
+      f32 t0 = (min.e[i] - origin.e[i]) * inv_direction.e[i];
+      f32 t1 = (max.e[i] - origin.e[i]) * inv_direction.e[i];
+      if (t0 > t1) { f32 tmp = t0; t0 = t1; t1 = tmp; }
+      t_min = t0 > t_min ? t0 : t_min;
+      t_max = t1 < t_max ? t1 : t_max;
+      if (t_max < t_min) return false;
+    }
+    t_entry = t_min;
+    return true;
+  }
+};
+
+HOST DEVICE inline aabb surrounding_box(const aabb &a, const aabb &b) {
+  aabb box = a;
+  box.grow(b);
+  return box;
+}
+
+#endif
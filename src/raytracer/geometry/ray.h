@@ -1,22 +1,40 @@
-
 #ifndef RAYH
 #define RAYH
 
 #include "vec3.h"
 
+#define RAY_T_MIN   0.001f      // default start of the traced interval, keeps scattered rays off their surface
+#define RAY_ID_NONE 0xffffffffu
+
+// Ray with what box tests need precomputed once at creation: 1 / direction
+// and the direction signs (bit a set when direction[a] < 0). t_min and t_max
+// are the interval the ray is traced over, id ties it to the pixel it was
+// traced for and is inherited by scattered rays.
 class ray {
 public:
   vec3 _origin;
   vec3 _direction;
+  vec3 _inv_direction;
+  u32 sign;
+  u32 id;
+  f32 t_min;
+  f32 t_max;
 
   DEVICE ray() {}
-  DEVICE ray(const vec3 &a, const vec3 &b) {
+  DEVICE ray(const vec3 &a, const vec3 &b, u32 ray_id = RAY_ID_NONE, f32 t0 = RAY_T_MIN, f32 t1 = INF) {
     _origin = a;
     _direction = b;
+    _inv_direction = vec3(1.0f / b.x(), 1.0f / b.y(), 1.0f / b.z());
+    sign = (b.x() < 0) | (b.y() < 0) << 1 | (b.z() < 0) << 2;
+    id = ray_id;
+    t_min = t0;
+    t_max = t1;
   }
 
-  DEVICE vec3 origin() const { return _origin; }
-  DEVICE vec3 direction() const { return _direction; }
+  DEVICE const vec3 &origin() const { return _origin; }
+  DEVICE const vec3 &direction() const { return _direction; }
+  DEVICE const vec3 &inv_direction() const { return _inv_direction; }
+  DEVICE bool negative(u32 axis) const { return (sign >> axis) & 1; }
   DEVICE vec3 at(f32 t) const { return _origin + t * _direction; }
 };
 
@@ -0,0 +1,79 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "aabb.h"
+
+// Packet widths the renderer can trace, one vector register per f32 lane set
+// with AVX-512 at 16, AVX2 at 8 and SSE at 4
+#define PACKET_MAX_SIZE 16
+
+// N f32 or i32 lanes as GCC vector extensions, lowered to the widest vector
+// unit the binary is compiled for. Comparisons give -1 (true) or 0 per lane.
+template <u32 N>
+struct packet_lanes {
+  typedef f32 f32v __attribute__((vector_size(N * sizeof(f32))));
+  typedef i32 i32v __attribute__((vector_size(N * sizeof(i32))));
+};
+
+template <u32 N>
+inline typename packet_lanes<N>::f32v lane_broadcast(f32 x) {
+  return typename packet_lanes<N>::f32v{} + x;
+}
+
+template <u32 N>
+inline u32 lane_mask(typename packet_lanes<N>::i32v m) {
+  u32 bits = 0;
+  for (u32 k = 0; k < N; k++) bits |= (u32)(m[k] & 1) << k;
+  return bits;
+}
+
+template <u32 N>
+inline typename packet_lanes<N>::i32v lane_select(u32 bits) {
+  typename packet_lanes<N>::i32v m;
+  for (u32 k = 0; k < N; k++) m[k] = (bits >> k) & 1 ? -1 : 0;
+  return m;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Packet of N rays in structure of arrays form. Lanes outside `active` hold
+// garbage and are masked out of every test.
+template <u32 N>
+struct ray_packet {
+  typedef typename packet_lanes<N>::f32v f32v;
+  typedef typename packet_lanes<N>::i32v i32v;
+
+  f32v origin[3];
+  f32v direction[3];
+  f32v inv_direction[3];
+  u32 id[N];
+  u32 active;
+
+  inline void set(u32 k, const ray &r) {
+    for (u32 a = 0; a < 3; a++) {
+      origin[a][k]        = r.origin().e[a];
+      direction[a][k]     = r.direction().e[a];
+      inv_direction[a][k] = r.inv_direction().e[a];
+    }
+    id[k] = r.id;
+  }
+
+  inline ray get(u32 k) const {
+    return ray(vec3(origin[0][k], origin[1][k], origin[2][k]), vec3(direction[0][k], direction[1][k], direction[2][k]), id[k]);
+  }
+
+  // Lanes in `mask` whose ray crosses the box within (t_min, t_max), the same
+  // slab test as aabb::hit
+  inline u32 hit_box(const aabb &box, f32v t_min, f32v t_max, u32 mask) const {
+    for (u32 a = 0; a < 3; a++) {
+      f32v t0 = (box.min.e[a] - origin[a]) * inv_direction[a];
+      f32v t1 = (box.max.e[a] - origin[a]) * inv_direction[a];
+      f32v near = t0 < t1 ? t0 : t1;
+      f32v far  = t0 < t1 ? t1 : t0;
+      t_min = near > t_min ? near : t_min;
+      t_max = far < t_max ? far : t_max;
+    }
+    return mask & lane_mask<N>(t_min <= t_max);
+  }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include "ray_packet.h"
+
+//--------------------------------------------------------------------------------------------------
+// Batch Sampling
+// The warps of vec3.h on N lanes at once. sin, cos and cbrt are polynomial
+// and Newton approximations good to a few f32 ulps, so a lane gives the same
+// point as the scalar warp up to rounding. Samples come in as arrays of
+// uniforms, drawn by the caller in the dimension order of the scalar warp.
+
+// sin and cos of 2 pi t for t in turns, any sign
+template <u32 N>
+inline void lane_sincos_turns(typename packet_lanes<N>::f32v t, typename packet_lanes<N>::f32v &s,
+                              typename packet_lanes<N>::f32v &c) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  typedef typename packet_lanes<N>::i32v i32v;
+  // Quadrant and angle within it in [0, pi / 2)
+  f32v q4 = t * 4.0f;
+  i32v q  = __builtin_convertvector(q4, i32v);
+  q      += __builtin_convertvector(q, f32v) > q4; // -1 where truncation rounded up
+  f32v x  = (q4 - __builtin_convertvector(q, f32v)) * f32(PI / 2);
+  f32v x2 = x * x;
+  // Taylor series, error below 1e-9 on [0, pi / 2]
+  f32v sx = x * (1.0f + x2 * (-1.0f / 6 + x2 * (1.0f / 120 + x2 * (-1.0f / 5040 + x2 * (1.0f / 362880 +
+            x2 * (-1.0f / 39916800 + x2 * (1.0f / 6227020800.0f)))))));
+  f32v cx = 1.0f + x2 * (-0.5f + x2 * (1.0f / 24 + x2 * (-1.0f / 720 + x2 * (1.0f / 40320 +
+            x2 * (-1.0f / 3628800 + x2 * (1.0f / 479001600 + x2 * (-1.0f / 87178291200.0f)))))));
+  // Rotate by the quadrant: (s, c) -> (c, -s) per quarter turn
+  q &= 3;
+  f32v rs = (q & 1) != 0 ? cx : sx;
+  f32v rc = (q & 1) != 0 ? sx : cx;
+  s = (q & 2) != 0 ? -rs : rs;
+  c = ((q + 1) & 2) != 0 ? -rc : rc;
+}
+
+// Cube root of x >= 0: exponent third as the first guess, then Newton
+template <u32 N>
+inline typename packet_lanes<N>::f32v lane_cbrt(typename packet_lanes<N>::f32v x) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  typedef typename packet_lanes<N>::i32v i32v;
+  f32v y = (f32v)((i32v)x / 3 + 709921077);
+  for (u32 k = 0; k < 4; k++) y = (2.0f * y + x / (y * y)) * (1.0f / 3);
+  return x > 0.0f ? y : f32v{};
+}
+
+template <u32 N>
+inline typename packet_lanes<N>::f32v lane_sqrt(typename packet_lanes<N>::f32v x) {
+  typename packet_lanes<N>::f32v r;
+  for (u32 k = 0; k < N; k++) r[k] = sqrtf(x[k]); // lowered to one vector sqrt
+  return r;
+}
+
+// sample_unit_disk
+template <u32 N>
+inline void sample_unit_disk_batch(const f32 *u1, const f32 *u2, f32 *x, f32 *y) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v a, b;
+  memcpy(&a, u1, sizeof(f32v));
+  memcpy(&b, u2, sizeof(f32v));
+  a = 2.0f * a - 1.0f;
+  b = 2.0f * b - 1.0f;
+  auto wide = a * a > b * b;
+  f32v r    = wide ? a : b;
+  f32v safe = r != 0.0f ? r : lane_broadcast<N>(1.0f);
+  // Angle in turns: b / a eighths, or a quarter minus a / b eighths
+  f32v phi = wide ? (b / safe) * 0.125f : 0.25f - (a / safe) * 0.125f;
+  f32v s, c;
+  lane_sincos_turns<N>(phi, s, c);
+  f32v rx = r * c, ry = r * s;
+  memcpy(x, &rx, sizeof(f32v));
+  memcpy(y, &ry, sizeof(f32v));
+}
+
+// sample_unit_sphere, scaled by radius
+template <u32 N>
+inline void sample_unit_sphere_batch(typename packet_lanes<N>::f32v u1, typename packet_lanes<N>::f32v u2,
+                                     typename packet_lanes<N>::f32v radius, typename packet_lanes<N>::f32v *xyz) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v z    = 1.0f - 2.0f * u1;
+  f32v zz   = 1.0f - z * z;
+  f32v rxy  = lane_sqrt<N>(zz > 0.0f ? zz : 0.0f);
+  f32v s, c;
+  lane_sincos_turns<N>(u2, s, c);
+  xyz[0] = radius * rxy * c;
+  xyz[1] = radius * rxy * s;
+  xyz[2] = radius * z;
+}
+
+template <u32 N>
+inline void sample_unit_sphere_batch(const f32 *u1, const f32 *u2, f32 *x, f32 *y, f32 *z) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v a, b, xyz[3];
+  memcpy(&a, u1, sizeof(f32v));
+  memcpy(&b, u2, sizeof(f32v));
+  sample_unit_sphere_batch<N>(a, b, lane_broadcast<N>(1.0f), xyz);
+  memcpy(x, &xyz[0], sizeof(f32v));
+  memcpy(y, &xyz[1], sizeof(f32v));
+  memcpy(z, &xyz[2], sizeof(f32v));
+}
+
+// sample_unit_ball
+template <u32 N>
+inline void sample_unit_ball_batch(const f32 *u1, const f32 *u2, const f32 *u3, f32 *x, f32 *y, f32 *z) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v a, b, c, xyz[3];
+  memcpy(&a, u1, sizeof(f32v));
+  memcpy(&b, u2, sizeof(f32v));
+  memcpy(&c, u3, sizeof(f32v));
+  sample_unit_sphere_batch<N>(a, b, lane_cbrt<N>(c), xyz);
+  memcpy(x, &xyz[0], sizeof(f32v));
+  memcpy(y, &xyz[1], sizeof(f32v));
+  memcpy(z, &xyz[2], sizeof(f32v));
+}
+
+// sample_cosine_hemisphere around the unit normals n, directions written over n
+template <u32 N>
+inline void sample_cosine_hemisphere_batch(const f32 *u1, const f32 *u2, f32 *nx, f32 *ny, f32 *nz) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v a, b, n[3], xyz[3];
+  memcpy(&a, u1, sizeof(f32v));
+  memcpy(&b, u2, sizeof(f32v));
+  memcpy(&n[0], nx, sizeof(f32v));
+  memcpy(&n[1], ny, sizeof(f32v));
+  memcpy(&n[2], nz, sizeof(f32v));
+  sample_unit_sphere_batch<N>(a, b, lane_broadcast<N>(1.0f), xyz);
+  for (u32 k = 0; k < 3; k++) xyz[k] += n[k];
+  auto degenerate = xyz[0] * xyz[0] + xyz[1] * xyz[1] + xyz[2] * xyz[2] < 1e-12f;
+  for (u32 k = 0; k < 3; k++) xyz[k] = degenerate ? n[k] : xyz[k];
+  memcpy(nx, &xyz[0], sizeof(f32v));
+  memcpy(ny, &xyz[1], sizeof(f32v));
+  memcpy(nz, &xyz[2], sizeof(f32v));
+}
+
+#endif
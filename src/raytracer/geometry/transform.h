@@ -0,0 +1,123 @@
+#ifndef TRANSFORMH
+#define TRANSFORMH
+
+#include "aabb.h"
+
+// Affine transform as the top 3 rows of a 4x4 matrix: m[i][0..2] is the
+// linear part, m[i][3] the translation. Points get the translation, vectors
+// do not.
+class transform {
+public:
+  f32 m[3][4];
+
+  HOST DEVICE transform() {}
+
+  HOST DEVICE static transform identity() {
+    transform t;
+    for (u32 i = 0; i < 3; i++) {
+      for (u32 j = 0; j < 4; j++) t.m[i][j] = i == j ? 1.0f : 0.0f;
+    }
+    return t;
+  }
+
+  HOST DEVICE static transform translation(const vec3 &offset) {
+    transform t = identity();
+    for (u32 i = 0; i < 3; i++) t.m[i][3] = offset.e[i];
+    return t;
+  }
+
+  HOST DEVICE static transform scaling(const vec3 &scale) {
+    transform t = identity();
+    for (u32 i = 0; i < 3; i++) t.m[i][i] = scale.e[i];
+    return t;
+  }
+
+  // Counterclockwise around the axis seen from its tip (Rodrigues)
+  HOST DEVICE static transform rotation(const vec3 &axis, f32 radians) {
+    vec3 a = normalize(axis);
+    f32 c = cosf(radians), s = sinf(radians), k = 1.0f - c;
+    transform t = identity();
+    t.m[0][0] = c + k * a.x() * a.x();
+    t.m[0][1] = k * a.x() * a.y() - s * a.z();
+    t.m[0][2] = k * a.x() * a.z() + s * a.y();
+    t.m[1][0] = k * a.y() * a.x() + s * a.z();
+    t.m[1][1] = c + k * a.y() * a.y();
+    t.m[1][2] = k * a.y() * a.z() - s * a.x();
+    t.m[2][0] = k * a.z() * a.x() - s * a.y();
+    t.m[2][1] = k * a.z() * a.y() + s * a.x();
+    t.m[2][2] = c + k * a.z() * a.z();
+    return t;
+  }
+
+  HOST DEVICE inline vec3 point(const vec3 &p) const {
+    return vec3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+  }
+
+  HOST DEVICE inline vec3 vector(const vec3 &v) const {
+    return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+  }
+
+  // Normals go through the inverse transpose: called on the inverse
+  // transform, this is a vector through its transposed linear part
+  HOST DEVICE inline vec3 normal_from_inverse(const vec3 &n) const {
+    return vec3(m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+                m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+                m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+  }
+
+  // Tightest box around the transformed box: every output axis sums the
+  // smaller and larger ends of each input axis (Arvo 1990)
+  HOST DEVICE inline aabb box(const aabb &b) const {
+    aabb out;
+    for (u32 i = 0; i < 3; i++) {
+      out.min.e[i] = m[i][3];
+      out.max.e[i] = m[i][3];
+      for (u32 j = 0; j < 3; j++) {
+        f32 lo = m[i][j] * b.min.e[j];
+        f32 hi = m[i][j] * b.max.e[j];
+        out.min.e[i] += MIN(lo, hi);
+        out.max.e[i] += MAX(lo, hi);
+      }
+    }
+    return out;
+  }
+
+  // Applies b then this
+  HOST DEVICE inline transform operator*(const transform &b) const {
+    transform t;
+    for (u32 i = 0; i < 3; i++) {
+      for (u32 j = 0; j < 4; j++) {
+        t.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + (j == 3 ? m[i][3] : 0.0f);
+      }
+    }
+    return t;
+  }
+
+  // Inverse of the linear part by cofactors, the matrix must not be singular
+  HOST DEVICE inline transform inverse() const {
+    transform t;
+    t.m[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    t.m[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+    t.m[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+    t.m[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    t.m[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+    t.m[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+    t.m[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    t.m[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+    t.m[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    f32 inv_det = 1.0f / (m[0][0] * t.m[0][0] + m[0][1] * t.m[1][0] + m[0][2] * t.m[2][0]);
+    for (u32 i = 0; i < 3; i++) {
+      for (u32 j = 0; j < 3; j++) t.m[i][j] *= inv_det;
+    }
+    for (u32 i = 0; i < 3; i++) {
+      t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+    }
+    return t;
+  }
+};
+
+#endif
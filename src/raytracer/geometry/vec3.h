@@ -118,25 +118,70 @@ DEVICE inline vec3 random_in_unit_square(randState *local_rand_state) {
   return rand_vec;
 }
 
-DEVICE inline vec3 random_in_unit_disk(randState *local_rand_state) {
-  while (true) {
-    vec3 rand_vec = random_vec3(-1, 1, local_rand_state);
-    rand_vec.e[2] = 0.0f;
-    if (rand_vec.norm_squared() < 1)
-      return rand_vec;
+// Rejection free warps: every call takes a fixed number of uniform samples, so
+// low discrepancy samplers see the same dimensions in every path
+
+// Concentric map of the square onto the unit disk (Shirley and Chiu)
+DEVICE inline vec3 sample_unit_disk(f32 u1, f32 u2) {
+  f32 a = 2.0f * u1 - 1.0f;
+  f32 b = 2.0f * u2 - 1.0f;
+  if (a == 0.0f && b == 0.0f) return vec3(0, 0, 0);
+  f32 r, phi;
+  if (a * a > b * b) {
+    r   = a;
+    phi = f32(PI / 4) * (b / a);
+  } else {
+    r   = b;
+    phi = f32(PI / 2) - f32(PI / 4) * (a / b);
   }
+  return vec3(r * cos(phi), r * sin(phi), 0.0f);
+}
+
+// Uniform direction: uniform z and azimuth (Archimedes)
+DEVICE inline vec3 sample_unit_sphere(f32 u1, f32 u2) {
+  f32 z   = 1.0f - 2.0f * u1;
+  f32 rxy = sqrt(MAX(0.0f, 1.0f - z * z));
+  f32 phi = f32(2 * PI) * u2;
+  return vec3(rxy * cos(phi), rxy * sin(phi), z);
+}
+
+// Uniform point in the unit ball: uniform direction, radius cbrt(u3)
+DEVICE inline vec3 sample_unit_ball(f32 u1, f32 u2, f32 u3) {
+  return cbrt(u3) * sample_unit_sphere(u1, u2);
+}
+
+// Cosine weighted direction around a unit normal: the direction of the normal
+// plus a uniform direction has density cos(theta) / pi. Not normalized, the
+// opposite direction falls back to the normal.
+DEVICE inline vec3 sample_cosine_hemisphere(const vec3 &normal, f32 u1, f32 u2) {
+  vec3 direction = normal + sample_unit_sphere(u1, u2);
+  if (direction.norm_squared() < 1e-12f) return normal;
+  return direction;
+}
+
+DEVICE inline vec3 random_in_unit_disk(randState *local_rand_state) {
+  f32 u1 = RANDOM_UNIFORM(local_rand_state);
+  f32 u2 = RANDOM_UNIFORM(local_rand_state);
+  return sample_unit_disk(u1, u2);
 }
 
 DEVICE inline vec3 random_in_unit_sphere(randState *local_rand_state) {
-  while (true) {
-    vec3 rand_vec = random_vec3(-1, 1, local_rand_state);
-    if (rand_vec.norm_squared() < 1)
-      return rand_vec;
-  }
+  f32 u1 = RANDOM_UNIFORM(local_rand_state);
+  f32 u2 = RANDOM_UNIFORM(local_rand_state);
+  f32 u3 = RANDOM_UNIFORM(local_rand_state);
+  return sample_unit_ball(u1, u2, u3);
 }
 
 DEVICE inline vec3 random_unit_vec3(randState *local_rand_state) {
-  return normalize(random_in_unit_sphere(local_rand_state));
+  f32 u1 = RANDOM_UNIFORM(local_rand_state);
+  f32 u2 = RANDOM_UNIFORM(local_rand_state);
+  return sample_unit_sphere(u1, u2);
+}
+
+DEVICE inline vec3 random_cosine_hemisphere(const vec3 &normal, randState *local_rand_state) {
+  f32 u1 = RANDOM_UNIFORM(local_rand_state);
+  f32 u2 = RANDOM_UNIFORM(local_rand_state);
+  return sample_cosine_hemisphere(normal, u1, u2);
 }
 
 DEVICE inline vec3 random_hemisphere_vec3(const vec3 &normal,
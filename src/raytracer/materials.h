@@ -3,64 +3,60 @@
 
 #include "geometry/ray.h"
 #include "objects/hittable.h"
+#include "../utils/arena.h"
 
-class material {
-public:
-  DEVICE virtual bool scatter(const ray &r_in, const hit_record &rec,
-                              vec3 &attenuation, ray &scattered,
-                              randState *local_rand_state) const = 0;
-};
+// Concrete type of a material, scatter and batched shading switch on it
+typedef enum {
+  MATERIAL_LAMBERTIAN,
+  MATERIAL_METAL,
+  MATERIAL_DIELECTRIC,
+  MATERIAL_KINDS
+} MaterialKind;
 
-class lambertian : public material {
+// Every material kind in one plain struct, so materials can be stored by value
+// in one contiguous table and referenced by index from hit records
+class material {
 public:
+  MaterialKind kind;
   vec3 albedo;
+  union {
+    f32 fuzz;    // metal
+    f32 ref_idx; // dielectric
+  };
+
+  DEVICE material() {}
+  DEVICE material(MaterialKind k, const vec3 &a, f32 parameter) : kind(k), albedo(a), fuzz(parameter) {}
+
+  DEVICE inline bool scatter(const ray &r_in, const hit_record &rec,
+                             vec3 &attenuation, ray &scattered,
+                             randState *local_rand_state) const;
 
-  DEVICE lambertian(const vec3 &a) : albedo(a) {}
-  DEVICE virtual bool scatter(const ray &r_in, const hit_record &rec,
-                              vec3 &attenuation, ray &scattered,
-                              randState *local_rand_state) const {
-    vec3 target = rec.p + rec.normal + random_in_unit_sphere(local_rand_state);
-    scattered = ray(rec.p, target - rec.p);
+  DEVICE inline bool scatter_lambertian(const ray &r_in, const hit_record &rec,
+                                        vec3 &attenuation, ray &scattered,
+                                        randState *local_rand_state) const {
+    scattered = ray(rec.p, random_cosine_hemisphere(rec.normal, local_rand_state), r_in.id);
     attenuation = albedo;
     return true;
   }
-};
 
-class metal : public material {
-public:
-  vec3 albedo;
-  f32 fuzz;
-
-  DEVICE metal(const vec3 &a, f32 f) : albedo(a) {
-    if (f < 1)
-      fuzz = f;
-    else
-      fuzz = 1;
-  }
-  DEVICE virtual bool scatter(const ray &r_in, const hit_record &rec,
-                              vec3 &attenuation, ray &scattered,
-                              randState *local_rand_state) const {
+  DEVICE inline bool scatter_metal(const ray &r_in, const hit_record &rec,
+                                   vec3 &attenuation, ray &scattered,
+                                   randState *local_rand_state) const {
     vec3 reflected = reflect(normalize(r_in.direction()), rec.normal);
     scattered =
-        ray(rec.p, reflected + fuzz * random_in_unit_sphere(local_rand_state));
+        ray(rec.p, reflected + fuzz * random_in_unit_sphere(local_rand_state), r_in.id);
     attenuation = albedo;
     return (dot(scattered.direction(), rec.normal) > 0.0f);
   }
-};
-
-class dielectric : public material {
-public:
-  f32 ref_idx;
 
-  DEVICE dielectric(f32 ri) : ref_idx(ri) {}
-  DEVICE virtual bool scatter(const ray &r_in, const hit_record &rec,
-                              vec3 &attenuation, ray &scattered,
-                              randState *local_rand_state) const {
+  DEVICE inline bool scatter_dielectric(const ray &r_in, const hit_record &rec,
+                                        vec3 &attenuation, ray &scattered,
+                                        randState *local_rand_state) const {
     vec3 outward_normal;
     vec3 reflected = reflect(r_in.direction(), rec.normal);
     f32 ni_over_nt;
     attenuation = vec3(1.0, 1.0, 1.0);
-    vec3 refracted;
+    vec3 refracted = reflected; // kept on total internal reflection, which always reflects
     f32 reflect_prob;
     f32 cosine;
     if (dot(r_in.direction(), rec.normal) > 0.0f) {
@@ -78,10 +74,130 @@ public:
     else
       reflect_prob = 1.0f;
     if (RANDOM_UNIFORM(local_rand_state) < reflect_prob)
-      scattered = ray(rec.p, reflected);
+      scattered = ray(rec.p, reflected, r_in.id);
     else
-      scattered = ray(rec.p, refracted);
+      scattered = ray(rec.p, refracted, r_in.id);
     return true;
   }
+
+  HOST DEVICE inline bool operator==(const material &m) const {
+    return kind == m.kind && albedo.x() == m.albedo.x() && albedo.y() == m.albedo.y() &&
+           albedo.z() == m.albedo.z() && fuzz == m.fuzz;
+  }
+};
+
+// Dispatch on the kind tag, the concrete scatter can be inlined
+DEVICE inline bool material::scatter(const ray &r_in, const hit_record &rec,
+                                     vec3 &attenuation, ray &scattered,
+                                     randState *local_rand_state) const {
+  switch (kind) {
+    case MATERIAL_LAMBERTIAN: return scatter_lambertian(r_in, rec, attenuation, scattered, local_rand_state);
+    case MATERIAL_METAL:      return scatter_metal(r_in, rec, attenuation, scattered, local_rand_state);
+    case MATERIAL_DIELECTRIC: return scatter_dielectric(r_in, rec, attenuation, scattered, local_rand_state);
+    default:                  return false;
+  }
+}
+
+// Russian roulette: a path whose throughput went down to q < 1 goes on with
+// probability q and is weighted by 1 / q, so the estimate stays unbiased while
+// dim paths stop early. Returns 0 when the path ends, its weight otherwise.
+DEVICE inline f32 roulette_weight(const vec3 &throughput, f32 u) {
+  f32 q = MAX(throughput.x(), MAX(throughput.y(), throughput.z()));
+  if (q >= 1.0f) return 1.0f;
+  return u < q ? 1.0f / q : 0.0f;
+}
+
+// Constructors of each kind, they add no data so they can be stored as material
+class lambertian : public material {
+public:
+  DEVICE lambertian(const vec3 &a) : material(MATERIAL_LAMBERTIAN, a, 0) {}
+};
+
+class metal : public material {
+public:
+  DEVICE metal(const vec3 &a, f32 f) : material(MATERIAL_METAL, a, f < 1 ? f : 1) {}
+};
+
+class dielectric : public material {
+public:
+  DEVICE dielectric(f32 ri) : material(MATERIAL_DIELECTRIC, vec3(1, 1, 1), ri) {}
+};
+
+//--------------------------------------------------------------------------------------------------
+// Material table used while building a world: add() returns the index of the
+// material, identical materials share one entry. Lookups go through an open
+// addressing table of entry indices, so deduplication costs 8 to 16 bytes per
+// material while building and nothing once the table is finished.
+
+class material_table {
+public:
+  material *entries;
+  u32 count;
+  u32 capacity;
+
+  material_table() : entries(NULL), count(0), capacity(0), slots(NULL), slots_count(0) {}
+  ~material_table() {
+    free(entries);
+    free(slots);
+  }
+
+  u32 add(const material &m) {
+    if (2 * (count + 1) > slots_count) rehash(MAX(64u, 2 * slots_count));
+    u32 mask = slots_count - 1;
+    for (u32 s = hash(m) & mask; ; s = (s + 1) & mask) {
+      if (slots[s] == MATERIAL_NONE) {
+        if (count == capacity) {
+          capacity = MAX(64u, 2 * capacity);
+          entries  = (material *) realloc(entries, capacity * sizeof(material));
+        }
+        entries[count] = m;
+        slots[s] = count;
+        return count++;
+      }
+      if (entries[slots[s]] == m) return slots[s];
+    }
+  }
+
+  // Copies the entries to the arena of the world, the table is empty afterwards
+  material *finish(arena &memory, u32 *materials_count) {
+    material *table  = memory.array<material>(count);
+    if (count > 0) memcpy(table, entries, count * sizeof(material));
+    *materials_count = count;
+    free(entries);
+    free(slots);
+    entries  = NULL;
+    slots    = NULL;
+    count    = capacity = slots_count = 0;
+    return table;
+  }
+
+private:
+  u32 *slots; // entry index or MATERIAL_NONE, power of two sized
+  u32 slots_count;
+
+  static u32 hash(const material &m) {
+    u64 h = (u64)m.kind;
+    const f32 values[4] = {m.albedo.x(), m.albedo.y(), m.albedo.z(), m.fuzz};
+    for (f32 value : values) {
+      u32 bits;
+      memcpy(&bits, &value, sizeof(bits));
+      h = (h ^ bits) * 0x100000001b3ull;
+    }
+    return (u32)(h ^ (h >> 32));
+  }
+
+  void rehash(u32 new_count) {
+    free(slots);
+    slots_count = new_count;
+    slots = (u32 *) malloc(slots_count * sizeof(u32));
+    memset(slots, 0xFF, slots_count * sizeof(u32));
+    u32 mask = slots_count - 1;
+    for (u32 e = 0; e < count; e++) {
+      u32 s = hash(entries[e]) & mask;
+      while (slots[s] != MATERIAL_NONE) s = (s + 1) & mask;
+      slots[s] = e;
+    }
+  }
 };
+
 #endif
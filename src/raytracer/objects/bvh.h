@@ -0,0 +1,784 @@
+#ifndef BVHH
+#define BVHH
+
+#include "hittable.h"
+#include "lbvh.h"
+#include "sphere_set.h"
+#include "../geometry/ray_packet.h"
+#include "../../utils/arena.h"
+
+#include <algorithm>
+#include <vector>
+
+#define BVH_SAH_BINS       16
+#define BVH_MAX_LEAF_SIZE  4
+#define BVH_STACK_SIZE     64
+// Past this depth the builder falls back to median splits so traversal never
+// overflows its fixed size stack
+#define BVH_MAX_SAH_DEPTH  40
+#define BVH_TRAVERSAL_COST 1.0f
+// Top subtrees of the LBVH flattened by each worker, per worker
+#define BVH_FLATTEN_TASKS  4
+// A refit cuts the tree into about this many subtrees, refit in parallel and
+// rebuilt one by one once they degrade
+#define BVH_REFIT_SUBTREES 64
+
+typedef enum {
+  BVH_BUILDER_SAH, // binned SAH, top down on one thread
+  BVH_BUILDER_LBVH // Morton order radix tree on every thread, lbvh.h
+} BvhBuilder;
+
+typedef struct BvhBuildSettings {
+  BvhBuilder builder;
+  u32 morton_bits;    // LBVH codes of 30 or 63 bits
+  u32 treelet_rounds; // LBVH treelet optimization passes, 0 for none
+  u32 threads;        // LBVH workers, 0 uses every hardware thread
+} BvhBuildSettings;
+
+inline BvhBuildSettings default_bvh_build_settings() {
+  BvhBuildSettings settings;
+  settings.builder        = BVH_BUILDER_SAH;
+  settings.morton_bits    = 63;
+  settings.treelet_rounds = 0;
+  settings.threads        = 0;
+  return settings;
+}
+
+// Refits rebuild the subtrees whose SAH cost grew past `degradation` times
+// their cost when built, and the whole tree when its cost did
+typedef struct BvhRefitSettings {
+  f32 degradation; // 0 only refits
+  u32 threads;     // refit and rebuild workers, 0 uses every hardware thread
+} BvhRefitSettings;
+
+inline BvhRefitSettings default_bvh_refit_settings() {
+  BvhRefitSettings settings;
+  settings.degradation = 1.3f;
+  settings.threads     = 0;
+  return settings;
+}
+
+typedef struct BvhRefitStats {
+  u32 subtrees;      // the tree was refit in
+  u32 rebuilt;       // subtrees rebuilt since they degraded
+  bool full_rebuild; // the whole tree degraded and was rebuilt
+  f32 cost;          // SAH cost after the update
+} BvhRefitStats;
+
+// Flattened BVH node in depth first order: the left child of an interior node
+// is the next node, `offset` points to the right child. Leaves use `offset` as
+// the first primitive in leaf order and have count > 0.
+struct bvh_node {
+  aabb box;
+  u32 offset;
+  u16 count;
+  u16 axis;
+};
+
+// Subtree refit as one unit. In depth first order its nodes [root, end) and
+// its leaf slots [first_slot, first_slot + slot_count) are contiguous.
+struct bvh_subtree {
+  u32 root, end;
+  u32 first_slot, slot_count;
+  u32 depth;
+  f32 built_cost; // SAH cost relative to the root box when last built
+};
+
+// What refits keep between frames: the subtrees and the nodes above them in
+// depth first order, allocated in the arena and grown when the cut changes
+struct bvh_refit_state {
+  bvh_subtree *subtrees;
+  u32 subtrees_count, subtrees_capacity;
+  u32 *top;
+  u32 top_count, top_capacity;
+  f32 built_cost;
+
+  bvh_refit_state()
+      : subtrees(NULL), subtrees_count(0), subtrees_capacity(0), top(NULL), top_count(0), top_capacity(0),
+        built_cost(0) {}
+};
+
+//--------------------------------------------------------------------------------------------------
+// Primitive agnostic BVH built with the binned surface area heuristic, or from
+// Morton codes for large inputs
+class bvh_tree {
+public:
+  bvh_node *nodes;
+  u32 node_count;
+  u32 node_capacity;
+  u32 *indices; // primitive index of each leaf slot
+  u32 prim_count;
+  u32 leaf_batch; // primitives a leaf tests at the cost of one (SIMD leaves)
+
+  bvh_tree() : nodes(NULL), node_count(0), node_capacity(0), indices(NULL), prim_count(0), leaf_batch(1) {}
+
+  // Nodes and indices are allocated in the arena, settings NULL builds with the SAH
+  void build(arena &memory, const aabb *boxes, u32 n, u32 max_leaf_size = BVH_MAX_LEAF_SIZE,
+             const BvhBuildSettings *settings = NULL);
+
+  // Writes count nodes over the current ones, the storage grows to the 2n - 1
+  // bound when they do not fit so later writes never allocate again
+  void assign_nodes(arena &memory, const bvh_node *source, u32 count);
+
+  // SAH cost of the tree relative to a ray hitting the root
+  f32 sah_cost() const;
+
+  // Cuts the tree into subtrees for refit() and records their current cost
+  void refit_cut(arena &memory, bvh_refit_state &state) const;
+
+  // Bounds of every node again from the boxes of the leaf slots: the subtrees
+  // bottom up on the workers, then the nodes above them. Subtrees degraded
+  // past settings->degradation are rebuilt with the SAH in place of the old
+  // ones, which permutes the slots inside them: old_slots[slot] receives the
+  // slot each primitive came from. The tree must have been cut by refit_cut.
+  BvhRefitStats refit(arena &memory, bvh_refit_state &state, const aabb *slot_boxes, u32 max_leaf_size,
+                      const BvhRefitSettings *settings, u32 *old_slots);
+
+  // Visits the leaves hit by the query ray front to back over its interval.
+  // leaf_hit(slot, query) is called for every primitive slot of a hit leaf
+  // and must shrink query.t_max on hit.
+  template <typename LeafHit>
+  DEVICE inline bool traverse(ray &query, LeafHit &leaf_hit) const;
+
+  // Packet version of traverse: a node is entered when any active ray hits
+  // it, leaf_hit(slot, mask) gets the lanes that hit the leaf box and must
+  // shrink their t_max. Children are ordered by the first active ray.
+  template <u32 N, typename LeafHit>
+  inline void traverse_packet(const ray_packet<N> &packet, f32 t_min,
+                              typename packet_lanes<N>::f32v &t_max,
+                              LeafHit &leaf_hit) const;
+
+private:
+  inline f32 intersect_cost(u32 n) const { return (f32)((n + leaf_batch - 1) / leaf_batch); }
+
+  f32 subtree_cost(u32 root, u32 end) const;
+
+  inline void refit_node(u32 k, const aabb *slot_boxes) {
+    bvh_node &node = nodes[k];
+    if (node.count > 0) {
+      aabb box;
+      for (u32 i = 0; i < node.count; i++) box.grow(slot_boxes[node.offset + i]);
+      node.box = box;
+    } else {
+      node.box = surrounding_box(nodes[k + 1].box, nodes[node.offset].box);
+    }
+  }
+
+  u32 build_recursive(std::vector<bvh_node> &out, const aabb *boxes,
+                      const vec3 *centroids, u32 begin, u32 end,
+                      u32 max_leaf_size, u32 depth);
+
+  // Flattens the radix tree below node to nodes[position] and the leaf slots
+  // from slot. With tasks, subtrees of up to task_leaves primitives are
+  // queued instead of flattened.
+  struct flatten_task {
+    u32 node, position, slot;
+  };
+  void flatten_lbvh(const lbvh_builder &builder, flatten_task task, u32 task_leaves,
+                    std::vector<flatten_task> *tasks);
+};
+
+template <typename LeafHit>
+DEVICE inline bool bvh_tree::traverse(ray &query, LeafHit &leaf_hit) const {
+  if (node_count == 0) return false;
+
+  const vec3 &origin = query.origin();
+  const vec3 &inv_direction = query.inv_direction();
+
+  u32 stack[BVH_STACK_SIZE];
+  u32 stack_size = 0;
+  u32 current = 0;
+  bool hit_anything = false;
+
+  while (true) {
+    const bvh_node &node = nodes[current];
+    f32 t_entry;
+    if (node.box.hit(origin, inv_direction, query.t_min, query.t_max, t_entry)) {
+      if (node.count > 0) {
+        for (u32 i = 0; i < node.count; i++) {
+          if (leaf_hit(node.offset + i, query)) hit_anything = true;
+        }
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+      } else if (query.negative(node.axis)) {
+        // Visit the near child first
+        stack[stack_size++] = current + 1;
+        current = node.offset;
+      } else {
+        stack[stack_size++] = node.offset;
+        current = current + 1;
+      }
+    } else {
+      if (stack_size == 0) break;
+      current = stack[--stack_size];
+    }
+  }
+  return hit_anything;
+}
+
+template <u32 N, typename LeafHit>
+inline void bvh_tree::traverse_packet(const ray_packet<N> &packet, f32 t_min,
+                                      typename packet_lanes<N>::f32v &t_max,
+                                      LeafHit &leaf_hit) const {
+  if (node_count == 0 || packet.active == 0) return;
+
+  u32 first = __builtin_ctz(packet.active);
+  bool dir_neg[3] = {packet.direction[0][first] < 0, packet.direction[1][first] < 0,
+                     packet.direction[2][first] < 0};
+  typename packet_lanes<N>::f32v t_min_lanes = lane_broadcast<N>(t_min);
+
+  u32 stack[BVH_STACK_SIZE];
+  u32 stack_size = 0;
+  u32 current = 0;
+
+  while (true) {
+    const bvh_node &node = nodes[current];
+    u32 mask = packet.hit_box(node.box, t_min_lanes, t_max, packet.active);
+    if (mask) {
+      if (node.count > 0) {
+        for (u32 i = 0; i < node.count; i++) leaf_hit(node.offset + i, mask);
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+      } else if (dir_neg[node.axis]) {
+        stack[stack_size++] = current + 1;
+        current = node.offset;
+      } else {
+        stack[stack_size++] = node.offset;
+        current = current + 1;
+      }
+    } else {
+      if (stack_size == 0) break;
+      current = stack[--stack_size];
+    }
+  }
+}
+
+inline void bvh_tree::build(arena &memory, const aabb *boxes, u32 n, u32 max_leaf_size,
+                            const BvhBuildSettings *settings) {
+  if (settings && settings->builder == BVH_BUILDER_LBVH && n > 1) {
+    lbvh_builder builder(max_leaf_size, leaf_batch, BVH_TRAVERSAL_COST);
+    builder.build(boxes, n, settings->morton_bits, settings->treelet_rounds, settings->threads);
+
+    // Degenerate inputs can make a radix tree deeper than the traversal stack
+    const lbvh_node &root = builder.nodes[builder.root];
+    if (root.height <= BVH_STACK_SIZE) {
+      prim_count    = n;
+      node_count    = root.flat_size;
+      node_capacity = node_count;
+      nodes         = memory.array<bvh_node>(node_count);
+      indices    = memory.array<u32>(n);
+
+      u32 threads = lbvh_threads(settings->threads, n);
+      std::vector<flatten_task> tasks;
+      flatten_task top = {builder.root, 0, 0};
+      if (threads == 1) flatten_lbvh(builder, top, n, NULL);
+      else flatten_lbvh(builder, top, MAX(1u, n / (BVH_FLATTEN_TASKS * threads)), &tasks);
+      parallel_ranges(tasks.size(), threads, [&](u32, u32 begin, u32 end) {
+        for (u32 t = begin; t < end; t++) flatten_lbvh(builder, tasks[t], n, NULL);
+      });
+      return;
+    }
+  }
+
+  prim_count = n;
+  indices = memory.array<u32>(n);
+  for (u32 i = 0; i < n; i++) indices[i] = i;
+  if (n == 0) return;
+
+  std::vector<vec3> centroids(n);
+  for (u32 i = 0; i < n; i++) centroids[i] = boxes[i].centroid();
+
+  std::vector<bvh_node> out;
+  out.reserve(2 * n);
+  build_recursive(out, boxes, centroids.data(), 0, n, max_leaf_size, 0);
+
+  node_count    = out.size();
+  node_capacity = node_count;
+  nodes = memory.array<bvh_node>(node_count);
+  std::copy(out.begin(), out.end(), nodes);
+}
+
+inline void bvh_tree::assign_nodes(arena &memory, const bvh_node *source, u32 count) {
+  if (count > node_capacity) {
+    node_capacity = MAX(count, 2 * prim_count - 1);
+    nodes = memory.array<bvh_node>(node_capacity);
+  }
+  node_count = count;
+  std::copy(source, source + count, nodes);
+}
+
+inline u32 bvh_tree::build_recursive(std::vector<bvh_node> &out, const aabb *boxes,
+                                     const vec3 *centroids, u32 begin, u32 end,
+                                     u32 max_leaf_size, u32 depth) {
+  u32 node_index = out.size();
+  out.push_back(bvh_node());
+
+  aabb bounds, centroid_bounds;
+  for (u32 i = begin; i < end; i++) {
+    bounds.grow(boxes[indices[i]]);
+    centroid_bounds.grow(centroids[indices[i]]);
+  }
+  out[node_index].box = bounds;
+
+  u32 n = end - begin;
+  vec3 extent = centroid_bounds.max - centroid_bounds.min;
+  u32 axis = 0;
+  if (extent.y() > extent.e[axis]) axis = 1;
+  if (extent.z() > extent.e[axis]) axis = 2;
+
+  // Every centroid on top of each other, no split can separate them
+  if (n <= 1 || extent.e[axis] <= 0.0f) {
+    if (n <= max_leaf_size || n <= 1) {
+      out[node_index].offset = begin;
+      out[node_index].count = n;
+      return node_index;
+    }
+  }
+
+  u32 mid = begin;
+  if (depth < BVH_MAX_SAH_DEPTH && extent.e[axis] > 0.0f) {
+    // Evaluate the binned SAH along every axis with a non degenerate extent
+    f32 best_cost = INF;
+    i32 best_axis = -1;
+    i32 best_bin = -1;
+    for (u32 a = 0; a < 3; a++) {
+      if (extent.e[a] <= 0.0f) continue;
+      aabb bin_boxes[BVH_SAH_BINS];
+      u32 bin_counts[BVH_SAH_BINS] = {0};
+      f32 scale = BVH_SAH_BINS / extent.e[a];
+      for (u32 i = begin; i < end; i++) {
+        i32 b = (i32)((centroids[indices[i]].e[a] - centroid_bounds.min.e[a]) * scale);
+        b = INTERVAL_CLAMP(0, BVH_SAH_BINS - 1, b);
+        bin_counts[b]++;
+        bin_boxes[b].grow(boxes[indices[i]]);
+      }
+
+      // Sweep from the right to get the cost of each split plane in one pass
+      f32 right_area[BVH_SAH_BINS];
+      u32 right_count[BVH_SAH_BINS];
+      aabb acc;
+      u32 count = 0;
+      for (i32 b = BVH_SAH_BINS - 1; b > 0; b--) {
+        acc.grow(bin_boxes[b]);
+        count += bin_counts[b];
+        right_area[b] = acc.surface_area();
+        right_count[b] = count;
+      }
+      acc = aabb();
+      count = 0;
+      for (i32 b = 0; b < BVH_SAH_BINS - 1; b++) {
+        acc.grow(bin_boxes[b]);
+        count += bin_counts[b];
+        if (count == 0 || right_count[b + 1] == 0) continue;
+        f32 cost = acc.surface_area() * intersect_cost(count) + right_area[b + 1] * intersect_cost(right_count[b + 1]);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = a;
+          best_bin = b;
+        }
+      }
+    }
+
+    if (best_axis >= 0) {
+      f32 leaf_cost = intersect_cost(n);
+      f32 split_cost = BVH_TRAVERSAL_COST + best_cost / bounds.surface_area();
+      if (n <= max_leaf_size && leaf_cost <= split_cost) {
+        out[node_index].offset = begin;
+        out[node_index].count = n;
+        return node_index;
+      }
+
+      f32 min_a = centroid_bounds.min.e[best_axis];
+      f32 scale = BVH_SAH_BINS / extent.e[best_axis];
+      u32 *split = std::partition(indices + begin, indices + end, [&](u32 p) {
+        i32 b = (i32)((centroids[p].e[best_axis] - min_a) * scale);
+        return INTERVAL_CLAMP(0, BVH_SAH_BINS - 1, b) <= best_bin;
+      });
+      mid = split - indices;
+      axis = best_axis;
+    }
+  }
+
+  // Too deep or no useful plane: split by object median
+  if (mid == begin || mid == end) {
+    mid = begin + n / 2;
+    std::nth_element(indices + begin, indices + mid, indices + end, [&](u32 a, u32 b) {
+      return centroids[a].e[axis] < centroids[b].e[axis];
+    });
+  }
+
+  build_recursive(out, boxes, centroids, begin, mid, max_leaf_size, depth + 1);
+  u32 right = build_recursive(out, boxes, centroids, mid, end, max_leaf_size, depth + 1);
+  out[node_index].offset = right;
+  out[node_index].count = 0;
+  out[node_index].axis = axis;
+  return node_index;
+}
+
+inline void bvh_tree::flatten_lbvh(const lbvh_builder &builder, flatten_task task, u32 task_leaves,
+                                   std::vector<flatten_task> *tasks) {
+  flatten_task stack[BVH_STACK_SIZE + 1];
+  u32 stack_size = 0;
+  stack[stack_size++] = task;
+  while (stack_size > 0) {
+    flatten_task item = stack[--stack_size];
+    const lbvh_node &source = builder.nodes[item.node];
+    if (tasks && !source.collapse && source.leaves <= task_leaves) {
+      tasks->push_back(item);
+      continue;
+    }
+
+    bvh_node &node = nodes[item.position];
+    node.box = source.box;
+    if (source.collapse) {
+      // Primitives of the subtree in the slots of the leaf
+      u32 subtree[BVH_STACK_SIZE];
+      u32 subtree_size = 0;
+      u32 slot = item.slot;
+      subtree[subtree_size++] = item.node;
+      while (subtree_size > 0) {
+        u32 k = subtree[--subtree_size];
+        if (builder.is_leaf(k)) {
+          indices[slot++] = builder.primitive(k);
+        } else {
+          subtree[subtree_size++] = builder.nodes[k].children[1];
+          subtree[subtree_size++] = builder.nodes[k].children[0];
+        }
+      }
+      node.offset = item.slot;
+      node.count  = source.leaves;
+      node.axis   = 0;
+      continue;
+    }
+
+    // Near child first along the axis separating the children the most
+    u32 a = source.children[0], b = source.children[1];
+    vec3 delta = builder.nodes[b].box.centroid() - builder.nodes[a].box.centroid();
+    u32 axis = 0;
+    if (fabsf(delta.y()) > fabsf(delta.e[axis])) axis = 1;
+    if (fabsf(delta.z()) > fabsf(delta.e[axis])) axis = 2;
+    if (delta.e[axis] < 0) std::swap(a, b);
+
+    const lbvh_node &left = builder.nodes[a];
+    node.offset = item.position + 1 + left.flat_size;
+    node.count  = 0;
+    node.axis   = axis;
+    stack[stack_size++] = {b, node.offset, item.slot + left.leaves};
+    stack[stack_size++] = {a, item.position + 1, item.slot};
+  }
+}
+
+inline f32 bvh_tree::sah_cost() const {
+  if (node_count == 0) return 0;
+  return subtree_cost(0, node_count);
+}
+
+inline f32 bvh_tree::subtree_cost(u32 root, u32 end) const {
+  f32 cost = 0;
+  for (u32 k = root; k < end; k++) {
+    f32 area = nodes[k].box.surface_area();
+    cost += nodes[k].count > 0 ? area * intersect_cost(nodes[k].count) : BVH_TRAVERSAL_COST * area;
+  }
+  f32 root_area = nodes[root].box.surface_area();
+  return root_area > 0 ? cost / root_area : 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Refit
+
+inline void bvh_tree::refit_cut(arena &memory, bvh_refit_state &state) const {
+  state.subtrees_count = 0;
+  state.top_count      = 0;
+  state.built_cost     = sah_cost();
+  if (node_count == 0) return;
+
+  // Subtrees of up to `limit` primitives, found in depth first order
+  u32 limit = MAX(1u, prim_count / BVH_REFIT_SUBTREES);
+  std::vector<bvh_subtree> subtrees;
+  std::vector<u32> top;
+  std::vector<std::pair<u32, u32>> stack(1, std::make_pair(0u, 0u));
+  while (!stack.empty()) {
+    u32 k     = stack.back().first;
+    u32 depth = stack.back().second;
+    stack.pop_back();
+
+    u32 first = k, last = k;
+    while (nodes[first].count == 0) first = first + 1;
+    while (nodes[last].count == 0) last = nodes[last].offset;
+    bvh_subtree subtree;
+    subtree.root       = k;
+    subtree.end        = last + 1;
+    subtree.first_slot = nodes[first].offset;
+    subtree.slot_count = nodes[last].offset + nodes[last].count - subtree.first_slot;
+    subtree.depth      = depth;
+    if (nodes[k].count > 0 || subtree.slot_count <= limit) {
+      subtree.built_cost = subtree_cost(subtree.root, subtree.end);
+      subtrees.push_back(subtree);
+    } else {
+      top.push_back(k);
+      stack.push_back(std::make_pair(nodes[k].offset, depth + 1));
+      stack.push_back(std::make_pair(k + 1, depth + 1));
+    }
+  }
+
+  if (subtrees.size() > state.subtrees_capacity) {
+    state.subtrees_capacity = MAX((u32)subtrees.size(), 2 * state.subtrees_capacity);
+    state.subtrees          = memory.array<bvh_subtree>(state.subtrees_capacity);
+  }
+  if (top.size() > state.top_capacity) {
+    state.top_capacity = MAX((u32)top.size(), 2 * state.top_capacity);
+    state.top          = memory.array<u32>(state.top_capacity);
+  }
+  state.subtrees_count = subtrees.size();
+  state.top_count      = top.size();
+  std::copy(subtrees.begin(), subtrees.end(), state.subtrees);
+  std::copy(top.begin(), top.end(), state.top);
+}
+
+inline BvhRefitStats bvh_tree::refit(arena &memory, bvh_refit_state &state, const aabb *slot_boxes,
+                                     u32 max_leaf_size, const BvhRefitSettings *settings, u32 *old_slots) {
+  BvhRefitStats stats;
+  stats.subtrees     = state.subtrees_count;
+  stats.rebuilt      = 0;
+  stats.full_rebuild = false;
+  for (u32 slot = 0; slot < prim_count; slot++) old_slots[slot] = slot;
+  if (node_count == 0) {
+    stats.cost = 0;
+    return stats;
+  }
+
+  // Children come after their parent, so a backward sweep is bottom up
+  u32 threads = lbvh_threads(settings->threads, state.subtrees_count);
+  std::vector<f32> costs(state.subtrees_count);
+  parallel_ranges(state.subtrees_count, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 s = begin; s < end; s++) {
+      const bvh_subtree &subtree = state.subtrees[s];
+      for (u32 k = subtree.end; k-- > subtree.root;) refit_node(k, slot_boxes);
+      costs[s] = subtree_cost(subtree.root, subtree.end);
+    }
+  });
+  for (u32 t = state.top_count; t-- > 0;) refit_node(state.top[t], slot_boxes);
+
+  std::vector<u32> degraded;
+  for (u32 s = 0; s < state.subtrees_count; s++) {
+    const bvh_subtree &subtree = state.subtrees[s];
+    if (settings->degradation > 0 && subtree.slot_count > 1 && costs[s] > settings->degradation * subtree.built_cost) {
+      degraded.push_back(s);
+    }
+  }
+  stats.rebuilt = degraded.size();
+
+  if (!degraded.empty()) {
+    // Each degraded subtree is built aside over its own slots, the depth of
+    // its root counts towards the median split fallback
+    std::vector<std::vector<bvh_node>> parts(degraded.size());
+    std::vector<std::vector<u32>> part_slots(degraded.size());
+    parallel_ranges(degraded.size(), MIN(threads, (u32)degraded.size()), [&](u32, u32 begin, u32 end) {
+      for (u32 d = begin; d < end; d++) {
+        const bvh_subtree &subtree = state.subtrees[degraded[d]];
+        const aabb *boxes = slot_boxes + subtree.first_slot;
+        std::vector<vec3> centroids(subtree.slot_count);
+        for (u32 i = 0; i < subtree.slot_count; i++) centroids[i] = boxes[i].centroid();
+        part_slots[d].resize(subtree.slot_count);
+        for (u32 i = 0; i < subtree.slot_count; i++) part_slots[d][i] = i;
+
+        bvh_tree part;
+        part.leaf_batch = leaf_batch;
+        part.indices    = part_slots[d].data();
+        parts[d].reserve(2 * subtree.slot_count);
+        part.build_recursive(parts[d], boxes, centroids.data(), 0, subtree.slot_count, max_leaf_size, subtree.depth);
+        part.nodes      = parts[d].data();
+        part.node_count = parts[d].size();
+        costs[degraded[d]] = part.subtree_cost(0, part.node_count);
+      }
+    });
+
+    // Nodes again in depth first order: the top as it was, kept subtrees
+    // moved as blocks, rebuilt ones from their part
+    std::vector<bvh_node> out;
+    out.reserve(node_count + 2 * prim_count / BVH_REFIT_SUBTREES + 2);
+    std::vector<std::pair<u32, u32>> stack(1, std::make_pair(0u, ~0u)); // node, parent waiting for its right child
+    u32 next_subtree = 0, next_top = 0, next_degraded = 0;
+    while (!stack.empty()) {
+      u32 k      = stack.back().first;
+      u32 parent = stack.back().second;
+      stack.pop_back();
+      u32 position = out.size();
+      if (parent != ~0u) out[parent].offset = position;
+
+      if (next_subtree < state.subtrees_count && state.subtrees[next_subtree].root == k) {
+        bvh_subtree &subtree = state.subtrees[next_subtree];
+        if (next_degraded < degraded.size() && degraded[next_degraded] == next_subtree) {
+          for (bvh_node node : parts[next_degraded]) {
+            node.offset += node.count > 0 ? subtree.first_slot : position;
+            out.push_back(node);
+          }
+          for (u32 i = 0; i < subtree.slot_count; i++) {
+            old_slots[subtree.first_slot + i] = subtree.first_slot + part_slots[next_degraded][i];
+          }
+          subtree.built_cost = costs[next_subtree];
+          next_degraded++;
+        } else {
+          for (u32 j = subtree.root; j < subtree.end; j++) {
+            bvh_node node = nodes[j];
+            if (node.count == 0) node.offset = node.offset - subtree.root + position;
+            out.push_back(node);
+          }
+        }
+        subtree.root = position;
+        subtree.end  = out.size();
+        next_subtree++;
+      } else {
+        state.top[next_top++] = position;
+        out.push_back(nodes[k]);
+        stack.push_back(std::make_pair(nodes[k].offset, position));
+        stack.push_back(std::make_pair(k + 1, ~0u));
+      }
+    }
+    assign_nodes(memory, out.data(), out.size());
+
+    std::vector<u32> old_indices(indices, indices + prim_count);
+    for (u32 slot = 0; slot < prim_count; slot++) indices[slot] = old_indices[old_slots[slot]];
+  }
+
+  // Whole tree cost from the subtree costs and the top nodes
+  f32 cost = 0;
+  for (u32 t = 0; t < state.top_count; t++) cost += BVH_TRAVERSAL_COST * nodes[state.top[t]].box.surface_area();
+  for (u32 s = 0; s < state.subtrees_count; s++) cost += costs[s] * nodes[state.subtrees[s].root].box.surface_area();
+  f32 root_area = nodes[0].box.surface_area();
+  stats.cost = root_area > 0 ? cost / root_area : 0;
+  return stats;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Hittable wrapper over a list of objects. refit() follows the objects after
+// they moved, sphere leaves are packed again from the new centers.
+class bvh : public hittable {
+public:
+  hittable **list; // objects in leaf order
+  u32 list_size;
+  bvh_tree tree;
+  u32 max_leaf_size;
+  bvh_refit_state refit_state; // cut at the first refit
+  sphere_set **sets;           // packed leaves, kept to be filled again by refits
+  u32 *set_leaves;             // node of each set in use
+  u32 sets_count, sets_used, sets_capacity;
+
+  bvh() : sets(NULL), set_leaves(NULL), sets_count(0), sets_used(0), sets_capacity(0) {}
+  // pack_spheres builds leaves SPHERE_SET_LANES wide and turns the ones made of
+  // spheres only into a single sphere_set tested with SIMD
+  bvh(arena &memory, hittable **l, u32 n, u32 leaf_size = BVH_MAX_LEAF_SIZE, bool pack_spheres = false,
+      const BvhBuildSettings *build = NULL)
+      : max_leaf_size(leaf_size), sets(NULL), set_leaves(NULL), sets_count(0), sets_used(0), sets_capacity(0) {
+    pack_spheres = pack_spheres && SPHERE_SET_LANES > 1;
+    if (pack_spheres) {
+      tree.leaf_batch = SPHERE_SET_LANES;
+      max_leaf_size   = SPHERE_SET_LANES;
+    }
+
+    aabb *boxes = new aabb[n];
+    for (u32 i = 0; i < n; i++) l[i]->bounding_box(boxes[i]);
+    tree.build(memory, boxes, n, max_leaf_size, build);
+    delete[] boxes;
+
+    list = memory.array<hittable *>(n);
+    list_size = n;
+    for (u32 i = 0; i < n; i++) list[i] = l[tree.indices[i]];
+    if (pack_spheres) pack_sphere_leaves(memory);
+  }
+
+  // Same contract as primitive_bvh::refit, `objects` being the array the tree
+  // was built from. Packed leaves are opened for the refit so every slot has
+  // its own box, then packed again into the sets already allocated.
+  BvhRefitStats refit(arena &memory, hittable **objects, const BvhRefitSettings *settings) {
+    BvhRefitStats stats = {0, 0, false, 0};
+    if (list_size == 0) return stats;
+    for (u32 s = 0; s < sets_used; s++) tree.nodes[set_leaves[s]].count = sets[s]->count;
+
+    aabb *boxes = new aabb[list_size];
+    for (u32 slot = 0; slot < list_size; slot++) objects[tree.indices[slot]]->bounding_box(boxes[slot]);
+    if (refit_state.subtrees == NULL) tree.refit_cut(memory, refit_state);
+    u32 *old_slots = new u32[list_size];
+    stats = tree.refit(memory, refit_state, boxes, max_leaf_size, settings, old_slots);
+
+    // The whole tree is built again from the boxes in their new slot order
+    if (settings->degradation > 0 && stats.cost > settings->degradation * refit_state.built_cost) {
+      std::vector<aabb> slot_boxes(list_size);
+      for (u32 slot = 0; slot < list_size; slot++) slot_boxes[slot] = boxes[old_slots[slot]];
+      bvh_tree sorted;
+      sorted.leaf_batch = tree.leaf_batch;
+      arena scratch;
+      sorted.build(scratch, slot_boxes.data(), list_size, max_leaf_size);
+      tree.assign_nodes(memory, sorted.nodes, sorted.node_count);
+      std::vector<u32> old_indices(tree.indices, tree.indices + list_size);
+      for (u32 slot = 0; slot < list_size; slot++) tree.indices[slot] = old_indices[sorted.indices[slot]];
+      tree.refit_cut(memory, refit_state);
+      stats.full_rebuild = true;
+      stats.cost         = tree.sah_cost();
+    }
+    delete[] old_slots;
+    delete[] boxes;
+
+    for (u32 slot = 0; slot < list_size; slot++) list[slot] = objects[tree.indices[slot]];
+    if (tree.leaf_batch > 1) pack_sphere_leaves(memory);
+    return stats;
+  }
+
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const {
+    hit_record temp_rec;
+    auto leaf_hit = [&](u32 slot, ray &closest_so_far) {
+      if (!list[slot]->hit(closest_so_far, temp_rec)) return false;
+      closest_so_far.t_max = temp_rec.t;
+      rec = temp_rec;
+      return true;
+    };
+    ray query = r;
+    return tree.traverse(query, leaf_hit);
+  }
+
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    if (tree.node_count == 0) return false;
+    box = tree.nodes[0].box;
+    return true;
+  }
+
+private:
+  // The set takes the first slot of its leaf, the other slots are left unused.
+  // Sets left by the previous packing are filled again before new ones are
+  // allocated, a leaf never holds more than their SPHERE_SET_LANES lanes.
+  void pack_sphere_leaves(arena &memory) {
+    sphere *spheres[SPHERE_SET_LANES];
+    sets_used = 0;
+    for (u32 k = 0; k < tree.node_count; k++) {
+      bvh_node &node = tree.nodes[k];
+      if (node.count < 2) continue;
+
+      bool only_spheres = true;
+      for (u32 i = 0; i < node.count && only_spheres; i++) {
+        spheres[i]   = dynamic_cast<sphere *>(list[node.offset + i]);
+        only_spheres = spheres[i] != NULL;
+      }
+      if (!only_spheres) continue;
+
+      if (sets_used == sets_count) {
+        if (sets_count == sets_capacity) {
+          sets_capacity = MAX(16u, 2 * sets_capacity);
+          sphere_set **grown_sets = memory.array<sphere_set *>(sets_capacity);
+          u32 *grown_leaves       = memory.array<u32>(sets_capacity);
+          std::copy(sets, sets + sets_count, grown_sets);
+          std::copy(set_leaves, set_leaves + sets_used, grown_leaves);
+          sets       = grown_sets;
+          set_leaves = grown_leaves;
+        }
+        sets[sets_count++] = memory.create<sphere_set>(memory, spheres, node.count);
+      } else {
+        sets[sets_used]->assign(spheres, node.count);
+      }
+      set_leaves[sets_used] = k;
+      list[node.offset] = sets[sets_used++];
+      node.count = 1;
+    }
+  }
+};
+
+#endif
@@ -1,20 +1,26 @@
 #ifndef HITABLEH
 #define HITABLEH
 
+#include "../geometry/aabb.h"
 #include "../geometry/ray.h"
 
-class material;
+// Index into the material table of the world, MATERIAL_NONE where an object
+// leaves the choice to its owner (a mesh under an instance)
+#define MATERIAL_NONE 0xFFFFFFFFu
+
 struct hit_record {
   f32 t;
   vec3 p;
   vec3 normal;
-  material *mat_ptr;
+  u32 material_index;
 };
 
+// hit searches the ray's own [t_min, t_max] interval, aggregates narrow a
+// copy of the ray to the closest hit found so far
 class hittable {
 public:
-  DEVICE virtual bool hit(const ray &r, f32 t_min, f32 t_max,
-                          hit_record &rec) const = 0;
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const = 0;
+  DEVICE virtual bool bounding_box(aabb &box) const = 0;
 };
 
 class hittable_list : public hittable {
@@ -27,24 +33,33 @@ public:
     list = l;
     list_size = n;
   }
-  DEVICE virtual bool hit(const ray &r, f32 tmin, f32 tmax,
-                          hit_record &rec) const;
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const;
+  DEVICE virtual bool bounding_box(aabb &box) const;
 };
 
-DEVICE inline bool hittable_list::hit(const ray &r, f32 t_min, f32 t_max,
-                               hit_record &rec) const {
+DEVICE inline bool hittable_list::hit(const ray &r, hit_record &rec) const {
   hit_record temp_rec;
   bool hit_anything = false;
-  f32 closest_so_far = t_max;
+  ray closest_so_far = r;
 
   for (u32 i = 0; i < list_size; i++) {
-    if (list[i]->hit(r, t_min, closest_so_far, temp_rec)) {
+    if (list[i]->hit(closest_so_far, temp_rec)) {
       hit_anything = true;
-      closest_so_far = temp_rec.t;
+      closest_so_far.t_max = temp_rec.t;
       rec = temp_rec;
     }
   }
   return hit_anything;
 }
 
+DEVICE inline bool hittable_list::bounding_box(aabb &box) const {
+  box = aabb();
+  for (u32 i = 0; i < list_size; i++) {
+    aabb object_box;
+    if (!list[i]->bounding_box(object_box)) return false;
+    box.grow(object_box);
+  }
+  return list_size > 0;
+}
+
 #endif
@@ -0,0 +1,54 @@
+#ifndef INSTANCEH
+#define INSTANCEH
+
+#include "triangle_mesh.h"
+#include "../geometry/transform.h"
+
+// Mesh placed in the world by an affine transform. The mesh geometry and its
+// BVH are the bottom level shared by every instance, each instance only
+// stores its transforms and optionally its own material, so copies cost a few
+// dozen bytes whatever the mesh size. Rays are moved into the mesh space
+// without normalizing their direction, which keeps hit distances the same in
+// both spaces.
+class instance : public hittable {
+public:
+  const triangle_mesh *mesh;
+  transform to_world; // mesh space to world space
+  transform to_local; // inverse of to_world
+  u32 material_index; // MATERIAL_NONE keeps the material of the mesh
+  bool translated;    // linear part is the identity, mesh normals stay unit length
+
+  instance() {}
+  instance(const triangle_mesh *m, const transform &t, u32 mat = MATERIAL_NONE) : mesh(m), material_index(mat) {
+    set_transform(t);
+  }
+  instance(const triangle_mesh *m, vec3 offset, u32 mat = MATERIAL_NONE)
+      : instance(m, transform::translation(offset), mat) {}
+
+  // The top level BVH over the instance must be rebuilt afterwards
+  void set_transform(const transform &t) {
+    to_world = t;
+    to_local = t.inverse();
+    translated = true;
+    for (u32 i = 0; i < 3; i++) {
+      for (u32 j = 0; j < 3; j++) translated = translated && t.m[i][j] == (i == j ? 1.0f : 0.0f);
+    }
+  }
+
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const {
+    ray local(to_local.point(r.origin()), to_local.vector(r.direction()), r.id, r.t_min, r.t_max);
+    if (!mesh->triangle_mesh::hit(local, rec)) return false;
+    rec.p      = to_world.point(rec.p);
+    if (!translated) rec.normal = normalize(to_local.normal_from_inverse(rec.normal));
+    if (material_index != MATERIAL_NONE) rec.material_index = material_index;
+    return true;
+  }
+
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    if (!mesh->triangle_mesh::bounding_box(box)) return false;
+    box = to_world.box(box);
+    return true;
+  }
+};
+
+#endif
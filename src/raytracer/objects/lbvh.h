@@ -0,0 +1,384 @@
+#ifndef LBVHH
+#define LBVHH
+
+#include "../geometry/aabb.h"
+
+#include <atomic>
+#include <memory>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Linear BVH construction (Karras 2012): the primitives are sorted along the
+// Morton curve of their centroids, the binary radix tree of the sorted codes
+// is emitted with every internal node found independently, then the bounds
+// and SAH costs are gathered bottom-up, optionally reorganizing treelets of a
+// few nodes for a lower SAH cost on the way (Karras and Aila 2013). Every
+// stage runs over contiguous ranges on the workers.
+
+#define LBVH_RADIX_BITS      8
+#define LBVH_RADIX_BUCKETS   (1 << LBVH_RADIX_BITS)
+#define LBVH_TREELET_LEAVES  7
+#define LBVH_TREELET_SUBSETS (1 << LBVH_TREELET_LEAVES)
+#define LBVH_NONE            0xffffffffu
+
+inline u32 lbvh_threads(u32 threads, u32 count) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  return MAX(1u, MIN(threads, count));
+}
+
+// Calls body(worker, begin, end) on `threads` workers over equal contiguous
+// ranges of [0, count), the same ranges for the same arguments
+template <typename Body>
+inline void parallel_ranges(u32 count, u32 threads, Body body) {
+  threads = MAX(1u, threads);
+  u32 per_worker = (count + threads - 1) / threads;
+  std::vector<std::thread> workers;
+  for (u32 w = 1; w < threads; w++) {
+    workers.emplace_back(body, w, MIN(w * per_worker, count), MIN((w + 1) * per_worker, count));
+  }
+  body(0, 0, MIN(per_worker, count));
+  for (std::thread &t : workers) t.join();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Morton codes and radix sort
+
+// Spreads the low 21 bits of v so that two zero bits follow each of them
+inline u64 morton_spread(u64 v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffull;
+  v = (v | v << 16) & 0x1f0000ff0000ffull;
+  v = (v | v << 8)  & 0x100f00f00f00f00full;
+  v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+  v = (v | v << 2)  & 0x1249249249249249ull;
+  return v;
+}
+
+inline u64 morton_code(u32 x, u32 y, u32 z) {
+  return (morton_spread(x) << 2) | (morton_spread(y) << 1) | morton_spread(z);
+}
+
+// Stable LSD radix sort of keys and their values on the low key_bits bits.
+// Every pass counts the digits of each worker range, then each worker
+// scatters its range from its own offsets so the order of equal keys is kept.
+inline void radix_sort(u64 *keys, u32 *values, u32 count, u32 key_bits, u32 threads) {
+  threads = lbvh_threads(threads, count);
+  std::vector<u64> key_buffer(count);
+  std::vector<u32> value_buffer(count);
+  std::vector<u32> offsets(threads * LBVH_RADIX_BUCKETS);
+  u64 *key_in = keys, *key_out = key_buffer.data();
+  u32 *value_in = values, *value_out = value_buffer.data();
+
+  for (u32 shift = 0; shift < key_bits; shift += LBVH_RADIX_BITS) {
+    parallel_ranges(count, threads, [&](u32 worker, u32 begin, u32 end) {
+      u32 *histogram = &offsets[worker * LBVH_RADIX_BUCKETS];
+      memset(histogram, 0, LBVH_RADIX_BUCKETS * sizeof(u32));
+      for (u32 i = begin; i < end; i++) histogram[(key_in[i] >> shift) & (LBVH_RADIX_BUCKETS - 1)]++;
+    });
+
+    u32 sum = 0;
+    for (u32 digit = 0; digit < LBVH_RADIX_BUCKETS; digit++) {
+      for (u32 w = 0; w < threads; w++) {
+        u32 digit_count = offsets[w * LBVH_RADIX_BUCKETS + digit];
+        offsets[w * LBVH_RADIX_BUCKETS + digit] = sum;
+        sum += digit_count;
+      }
+    }
+
+    parallel_ranges(count, threads, [&](u32 worker, u32 begin, u32 end) {
+      u32 *next = &offsets[worker * LBVH_RADIX_BUCKETS];
+      for (u32 i = begin; i < end; i++) {
+        u32 slot = next[(key_in[i] >> shift) & (LBVH_RADIX_BUCKETS - 1)]++;
+        key_out[slot]   = key_in[i];
+        value_out[slot] = value_in[i];
+      }
+    });
+    std::swap(key_in, key_out);
+    std::swap(value_in, value_out);
+  }
+
+  if (key_in != keys) {
+    memcpy(keys, key_in, count * sizeof(u64));
+    memcpy(values, value_in, count * sizeof(u32));
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Binary radix tree
+
+// Internal nodes come first, then one leaf per primitive in Morton order
+struct lbvh_node {
+  aabb box;
+  u32 children[2];
+  u32 parent;
+  u32 leaves;    // primitives below
+  u32 flat_size; // nodes once flattened with the collapsed subtrees as leaves
+  u32 height;    // levels once flattened
+  f32 cost;      // SAH cost times the surface area
+  bool collapse; // the subtree is cheaper as a single leaf
+};
+
+class lbvh_builder {
+public:
+  std::vector<lbvh_node> nodes;
+  std::vector<u32> order; // primitive of each leaf
+  u32 first_leaf;
+  u32 root;
+
+  // A subtree of at most max_leaf_size primitives may collapse in a leaf,
+  // which tests leaf_batch primitives at the cost of one
+  lbvh_builder(u32 max_leaf_size, u32 leaf_batch, f32 traversal_cost)
+      : first_leaf(0), root(LBVH_NONE), max_leaf_size(max_leaf_size), leaf_batch(leaf_batch),
+        traversal_cost(traversal_cost) {}
+
+  // morton_bits is 30 or 63, treelet_rounds 0 skips the treelet optimization
+  void build(const aabb *boxes, u32 n, u32 morton_bits, u32 treelet_rounds, u32 threads);
+
+  inline bool is_leaf(u32 node) const { return node >= first_leaf; }
+  inline u32 primitive(u32 node) const { return order[node - first_leaf]; }
+
+private:
+  u32 max_leaf_size;
+  u32 leaf_batch;
+  f32 traversal_cost;
+  u32 threads;
+  std::vector<u64> keys;
+  std::unique_ptr<std::atomic<u32>[]> visits;
+
+  inline f32 intersect_cost(u32 n) const { return (f32)((n + leaf_batch - 1) / leaf_batch); }
+
+  // Common prefix length of the codes at i and j, ties broken by the index
+  inline i32 delta(i32 i, i32 j) const {
+    if (j < 0 || j > (i32)first_leaf) return -1;
+    u64 difference = keys[i] ^ keys[j];
+    if (difference == 0) return 64 + __builtin_clz((u32)i ^ (u32)j);
+    return __builtin_clzll(difference);
+  }
+
+  void emit_internal(u32 i);
+  void update(u32 node);
+  void bottom_up(u32 treelet_min_leaves);
+  void optimize_treelet(u32 treelet_root);
+  u32 emit_treelet(u32 subset, const u32 *leaves, const u32 *internals, u32 &next_internal, const u8 *split);
+};
+
+inline void lbvh_builder::build(const aabb *boxes, u32 n, u32 morton_bits, u32 treelet_rounds, u32 requested_threads) {
+  nodes.resize(n > 0 ? 2 * n - 1 : 0);
+  order.resize(n);
+  if (n == 0) return;
+  threads    = lbvh_threads(requested_threads, n);
+  first_leaf = n - 1;
+  root       = n == 1 ? first_leaf : 0;
+
+  std::vector<aabb> worker_bounds(threads);
+  parallel_ranges(n, threads, [&](u32 worker, u32 begin, u32 end) {
+    for (u32 i = begin; i < end; i++) worker_bounds[worker].grow(boxes[i].centroid());
+  });
+  aabb centroid_bounds;
+  for (const aabb &bounds : worker_bounds) centroid_bounds.grow(bounds);
+
+  // Centroids quantized on a grid of 2^axis_bits cells per axis
+  u32 axis_bits = MIN(morton_bits, 63u) / 3;
+  f32 cells = (f32)((1u << axis_bits) - 1);
+  vec3 scale;
+  for (u32 a = 0; a < 3; a++) {
+    f32 extent = centroid_bounds.max.e[a] - centroid_bounds.min.e[a];
+    scale.e[a] = extent > 0 ? cells / extent : 0;
+  }
+  keys.resize(n);
+  parallel_ranges(n, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 i = begin; i < end; i++) {
+      vec3 c = boxes[i].centroid();
+      u32 q[3];
+      for (u32 a = 0; a < 3; a++) q[a] = (u32)MIN(cells, (c.e[a] - centroid_bounds.min.e[a]) * scale.e[a]);
+      keys[i]  = morton_code(q[0], q[1], q[2]);
+      order[i] = i;
+    }
+  });
+  radix_sort(keys.data(), order.data(), n, 3 * axis_bits, threads);
+
+  parallel_ranges(n, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 k = begin; k < end; k++) {
+      lbvh_node &leaf = nodes[first_leaf + k];
+      leaf.box       = boxes[order[k]];
+      leaf.children[0] = leaf.children[1] = LBVH_NONE;
+      leaf.leaves    = 1;
+      leaf.flat_size = 1;
+      leaf.height    = 1;
+      leaf.cost      = leaf.box.surface_area() * intersect_cost(1);
+      leaf.collapse  = true;
+    }
+  });
+  parallel_ranges(n - 1, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 i = begin; i < end; i++) emit_internal(i);
+  });
+  nodes[root].parent = LBVH_NONE;
+  keys.clear();
+  keys.shrink_to_fit();
+
+  // Every round only reorganizes treelets under subtrees twice as large as
+  // the previous one, the first pass also computes the bounds
+  visits.reset(new std::atomic<u32>[n]);
+  u32 min_leaves = treelet_rounds > 0 ? LBVH_TREELET_LEAVES : 0;
+  for (u32 round = 0; round < MAX(treelet_rounds, 1u); round++) {
+    bottom_up(min_leaves);
+    min_leaves *= 2;
+  }
+  visits.reset();
+}
+
+// Children of internal node i: the range of codes it covers extends from i
+// in the direction of the neighbour sharing the longer prefix, and splits
+// where the prefix of the whole range stops being shared
+inline void lbvh_builder::emit_internal(u32 node) {
+  i32 i = node;
+  i32 d = delta(i, i + 1) - delta(i, i - 1) > 0 ? 1 : -1;
+  i32 delta_min = delta(i, i - d);
+
+  i32 length_max = 2;
+  while (delta(i, i + length_max * d) > delta_min) length_max *= 2;
+  i32 length = 0;
+  for (i32 t = length_max / 2; t >= 1; t /= 2) {
+    if (delta(i, i + (length + t) * d) > delta_min) length += t;
+  }
+  i32 j = i + length * d;
+
+  i32 delta_node = delta(i, j);
+  i32 split = 0;
+  i32 t = length;
+  do {
+    t = (t + 1) / 2;
+    if (delta(i, i + (split + t) * d) > delta_node) split += t;
+  } while (t > 1);
+  i32 gamma = i + split * d + MIN(d, 0);
+
+  lbvh_node &internal = nodes[node];
+  internal.children[0] = MIN(i, j) == gamma ? first_leaf + gamma : gamma;
+  internal.children[1] = MAX(i, j) == gamma + 1 ? first_leaf + gamma + 1 : gamma + 1;
+  nodes[internal.children[0]].parent = node;
+  nodes[internal.children[1]].parent = node;
+}
+
+// Bounds and cost of an internal node from its children
+inline void lbvh_builder::update(u32 node) {
+  lbvh_node &internal = nodes[node];
+  const lbvh_node &a = nodes[internal.children[0]];
+  const lbvh_node &b = nodes[internal.children[1]];
+  internal.box    = surrounding_box(a.box, b.box);
+  internal.leaves = a.leaves + b.leaves;
+
+  f32 area       = internal.box.surface_area();
+  f32 split_cost = traversal_cost * area + a.cost + b.cost;
+  f32 leaf_cost  = area * intersect_cost(internal.leaves);
+  internal.collapse  = internal.leaves <= max_leaf_size && leaf_cost <= split_cost;
+  internal.cost      = internal.collapse ? leaf_cost : split_cost;
+  internal.flat_size = internal.collapse ? 1 : 1 + a.flat_size + b.flat_size;
+  internal.height    = internal.collapse ? 1 : 1 + MAX(a.height, b.height);
+}
+
+// Walks up from every leaf, the second child to arrive at a node updates it
+// so the whole subtree below is final
+inline void lbvh_builder::bottom_up(u32 treelet_min_leaves) {
+  parallel_ranges(first_leaf, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 i = begin; i < end; i++) visits[i].store(0, std::memory_order_relaxed);
+  });
+  parallel_ranges(first_leaf + 1, threads, [&](u32, u32 begin, u32 end) {
+    for (u32 k = begin; k < end; k++) {
+      u32 node = nodes[first_leaf + k].parent;
+      while (node != LBVH_NONE) {
+        if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+        update(node);
+        if (treelet_min_leaves > 0 && nodes[node].leaves >= treelet_min_leaves) optimize_treelet(node);
+        node = nodes[node].parent;
+      }
+    }
+  });
+}
+
+// Grows a treelet from treelet_root by opening its largest leaf until it has
+// LBVH_TREELET_LEAVES of them, then finds the topology of least SAH cost over
+// those leaves by dynamic programming on their subsets and rebuilds the
+// treelet with it when it is cheaper, reusing its internal nodes
+inline void lbvh_builder::optimize_treelet(u32 treelet_root) {
+  u32 leaves[LBVH_TREELET_LEAVES];
+  u32 internals[LBVH_TREELET_LEAVES - 1];
+  u32 leaf_count = 2, internal_count = 1;
+  leaves[0]    = nodes[treelet_root].children[0];
+  leaves[1]    = nodes[treelet_root].children[1];
+  internals[0] = treelet_root;
+  while (leaf_count < LBVH_TREELET_LEAVES) {
+    i32 largest = -1;
+    f32 largest_area = -1;
+    for (u32 k = 0; k < leaf_count; k++) {
+      if (is_leaf(leaves[k])) continue;
+      f32 area = nodes[leaves[k]].box.surface_area();
+      if (area > largest_area) {
+        largest_area = area;
+        largest = k;
+      }
+    }
+    if (largest < 0) break;
+    u32 opened = leaves[largest];
+    internals[internal_count++] = opened;
+    leaves[largest]        = nodes[opened].children[0];
+    leaves[leaf_count++]   = nodes[opened].children[1];
+  }
+
+  // Subsets in increasing order come after all of their own subsets
+  aabb boxes[LBVH_TREELET_SUBSETS];
+  f32 costs[LBVH_TREELET_SUBSETS];
+  u32 primitives[LBVH_TREELET_SUBSETS];
+  u8 split[LBVH_TREELET_SUBSETS];
+  u32 full = (1u << leaf_count) - 1;
+  for (u32 subset = 1; subset <= full; subset++) {
+    u32 lowest = subset & (0u - subset);
+    if (subset == lowest) {
+      const lbvh_node &leaf = nodes[leaves[__builtin_ctz(subset)]];
+      boxes[subset]      = leaf.box;
+      costs[subset]      = leaf.cost;
+      primitives[subset] = leaf.leaves;
+      continue;
+    }
+    boxes[subset]      = surrounding_box(boxes[lowest], boxes[subset ^ lowest]);
+    primitives[subset] = primitives[lowest] + primitives[subset ^ lowest];
+
+    // Each partition once: the left side keeps the lowest leaf and a proper
+    // subset of the others
+    u32 others = subset ^ lowest;
+    f32 best = INF;
+    for (u32 rest = (others - 1) & others; ; rest = (rest - 1) & others) {
+      u32 left = lowest | rest;
+      f32 cost = costs[left] + costs[subset ^ left];
+      if (cost < best) {
+        best = cost;
+        split[subset] = left;
+      }
+      if (rest == 0) break;
+    }
+    f32 area       = boxes[subset].surface_area();
+    f32 split_cost = traversal_cost * area + best;
+    f32 leaf_cost  = area * intersect_cost(primitives[subset]);
+    costs[subset]  = primitives[subset] <= max_leaf_size ? MIN(split_cost, leaf_cost) : split_cost;
+  }
+  if (costs[full] >= nodes[treelet_root].cost * (1.0f - 1e-5f)) return;
+
+  u32 next_internal = 0;
+  emit_treelet(full, leaves, internals, next_internal, split);
+}
+
+inline u32 lbvh_builder::emit_treelet(u32 subset, const u32 *leaves, const u32 *internals, u32 &next_internal,
+                                      const u8 *split) {
+  if ((subset & (subset - 1)) == 0) return leaves[__builtin_ctz(subset)];
+  u32 node = internals[next_internal++];
+  u32 a = emit_treelet(split[subset], leaves, internals, next_internal, split);
+  u32 b = emit_treelet(subset ^ split[subset], leaves, internals, next_internal, split);
+  nodes[node].children[0] = a;
+  nodes[node].children[1] = b;
+  nodes[a].parent = node;
+  nodes[b].parent = node;
+  update(node);
+  return node;
+}
+
+#endif
@@ -0,0 +1,419 @@
+#ifndef PRIMITIVEH
+#define PRIMITIVEH
+
+#include "bvh.h"
+#include "instance.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+
+#include <new>
+#include <typeinfo>
+
+// Closed set of primitive types. Adding a type means adding its array and a
+// case to every switch below.
+typedef enum {
+  PRIMITIVE_SPHERE,
+  PRIMITIVE_TRIANGLE,
+  PRIMITIVE_MESH,
+  PRIMITIVE_INSTANCE,
+  PRIMITIVE_TYPES
+} PrimitiveType;
+
+// Tagged reference into the array of its type
+struct primitive_ref {
+  u32 type;
+  u32 index;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Packet intersection tests: the scalar tests run on N rays at once. They
+// return the lanes of `mask` hit closer than t_max and shrink t_max there.
+
+// Same arithmetic as sphere::hit so both paths agree on every bit
+template <u32 N>
+inline u32 intersect_sphere_packet(const sphere &s, const ray_packet<N> &packet, f32 t_min,
+                                   typename packet_lanes<N>::f32v &t_max, u32 mask) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  f32v ocx = packet.origin[0] - s.center.x();
+  f32v ocy = packet.origin[1] - s.center.y();
+  f32v ocz = packet.origin[2] - s.center.z();
+  const f32v *d = packet.direction;
+  f32v a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+  f32v h = ocx * d[0] + ocy * d[1] + ocz * d[2];
+  f32v c = (ocx * ocx + ocy * ocy + ocz * ocz) - s.radius * s.radius;
+  f32v discriminant = h * h - a * c;
+  mask &= lane_mask<N>(discriminant > 0);
+  if (!mask) return 0;
+
+  f32v sq = discriminant;
+  for (u32 k = 0; k < N; k++) sq[k] = sqrtf(MAX(sq[k], 0.0f));
+  f32v t0 = (-h - sq) / a;
+  f32v t1 = (-h + sq) / a;
+
+  u32 m0 = mask & lane_mask<N>((t0 > t_min) & (t0 < t_max));
+  u32 m1 = mask & ~m0 & lane_mask<N>((t1 > t_min) & (t1 < t_max));
+  u32 m  = m0 | m1;
+  if (m) {
+    f32v t = lane_select<N>(m0) ? t0 : t1;
+    t_max  = lane_select<N>(m) ? t : t_max;
+  }
+  return m;
+}
+
+// Same arithmetic as intersect_triangle, writes the barycentrics of the hit lanes
+template <u32 N>
+inline u32 intersect_triangle_packet(const triangle &tri, const ray_packet<N> &packet, f32 t_min,
+                                     typename packet_lanes<N>::f32v &t_max, u32 mask,
+                                     typename packet_lanes<N>::f32v &hit_u,
+                                     typename packet_lanes<N>::f32v &hit_v) {
+  typedef typename packet_lanes<N>::f32v f32v;
+  vec3 e1 = tri.vertices[1] - tri.vertices[0];
+  vec3 e2 = tri.vertices[2] - tri.vertices[0];
+  const f32v *d = packet.direction;
+
+  f32v px = d[1] * e2.z() - d[2] * e2.y();
+  f32v py = -(d[0] * e2.z() - d[2] * e2.x());
+  f32v pz = d[0] * e2.y() - d[1] * e2.x();
+  f32v det = e1.x() * px + e1.y() * py + e1.z() * pz;
+  // det <= (f32)EPSILON is det < EPSILON in double, no float lies in between
+  if (tri.back_culling) mask &= lane_mask<N>(det > (f32)EPSILON);
+  if (!mask) return 0;
+  f32v inv_det = 1.f / det;
+
+  f32v tx = packet.origin[0] - tri.vertices[0].x();
+  f32v ty = packet.origin[1] - tri.vertices[0].y();
+  f32v tz = packet.origin[2] - tri.vertices[0].z();
+  f32v u  = (tx * px + ty * py + tz * pz) * inv_det;
+  mask &= lane_mask<N>((u >= 0.f) & (u <= 1.f));
+  if (!mask) return 0;
+
+  f32v qx = ty * e1.z() - tz * e1.y();
+  f32v qy = -(tx * e1.z() - tz * e1.x());
+  f32v qz = tx * e1.y() - ty * e1.x();
+  f32v v  = (d[0] * qx + d[1] * qy + d[2] * qz) * inv_det;
+  f32v t  = (e2.x() * qx + e2.y() * qy + e2.z() * qz) * inv_det;
+  u32 m = mask & lane_mask<N>((v >= 0.f) & (u + v <= 1.f) & (t > t_min) & (t < t_max));
+  if (m) {
+    typename packet_lanes<N>::i32v hit = lane_select<N>(m);
+    t_max = hit ? t : t_max;
+    hit_u = hit ? u : hit_u;
+    hit_v = hit ? v : hit_v;
+  }
+  return m;
+}
+
+//--------------------------------------------------------------------------------------------------
+// BVH over flat primitive arrays dispatched by type tag: the objects are
+// copied by value into one array per type, in BVH leaf order, and every
+// intersection is a switch plus a qualified (non virtual) call the compiler
+// can inline. Only the top level hit stays virtual so it can be used as the
+// world collider. Objects outside the closed set can not be stored, supports()
+// tells whether a list fits before building. Over instances
+// this is the top level of a two level BVH: rebuild() sorts it again after
+// instances moved without touching the meshes below. refit() follows moving
+// objects frame after frame for a fraction of a rebuild.
+class primitive_bvh : public hittable {
+public:
+  sphere *spheres;
+  triangle *triangles;
+  triangle_mesh *meshes;
+  instance *instances;
+  u32 counts[PRIMITIVE_TYPES];
+  primitive_ref *refs; // in leaf order
+  u32 refs_count;
+  bvh_tree tree;
+  u32 max_leaf_size;
+  bvh_refit_state refit_state; // cut at the first refit
+
+  // Every object must be a primitive, see supports()
+  primitive_bvh(arena &memory, hittable **objects, u32 n, u32 leaf_size = BVH_MAX_LEAF_SIZE,
+                const BvhBuildSettings *build = NULL) {
+    max_leaf_size = leaf_size;
+    refs_count = n;
+    refs       = memory.array<primitive_ref>(n);
+    for (u32 t = 0; t < PRIMITIVE_TYPES; t++) counts[t] = 0;
+
+    u32 *types  = new u32[n];
+    aabb *boxes = new aabb[n];
+    for (u32 i = 0; i < n; i++) {
+      types[i] = primitive_type(objects[i]);
+      counts[types[i]]++;
+      objects[i]->bounding_box(boxes[i]);
+    }
+    tree.build(memory, boxes, n, max_leaf_size, build);
+    delete[] boxes;
+
+    spheres   = memory.array<sphere>(counts[PRIMITIVE_SPHERE]);
+    triangles = memory.array<triangle>(counts[PRIMITIVE_TRIANGLE]);
+    meshes    = memory.array<triangle_mesh>(counts[PRIMITIVE_MESH]);
+    instances = memory.array<instance>(counts[PRIMITIVE_INSTANCE]);
+
+    // Copy in leaf order so a leaf reads neighbouring elements
+    u32 next[PRIMITIVE_TYPES] = {0};
+    for (u32 slot = 0; slot < n; slot++) {
+      u32 i = tree.indices[slot];
+      u32 type = types[i];
+      u32 index = next[type]++;
+      switch (type) {
+        case PRIMITIVE_SPHERE:   new (&spheres[index]) sphere(*(sphere *) objects[i]); break;
+        case PRIMITIVE_TRIANGLE: new (&triangles[index]) triangle(*(triangle *) objects[i]); break;
+        case PRIMITIVE_MESH:     new (&meshes[index]) triangle_mesh(*(triangle_mesh *) objects[i]); break;
+        case PRIMITIVE_INSTANCE: new (&instances[index]) instance(*(instance *) objects[i]); break;
+      }
+      refs[slot].type  = type;
+      refs[slot].index = index;
+    }
+    delete[] types;
+  }
+
+  // Builds the tree again from the current boxes of the objects, after an
+  // instance got a new transform for example, and copies the arrays into the
+  // new leaf order. The tree is built aside and copied over the old one, so
+  // once the nodes were grown to their bound of 2n - 1 repeated rebuilds use
+  // no more memory.
+  virtual void rebuild(arena &memory, const BvhBuildSettings *build = NULL) {
+    if (refs_count == 0) return;
+    aabb *boxes = new aabb[refs_count];
+    for (u32 slot = 0; slot < refs_count; slot++) primitive_box(refs[slot], boxes[slot]);
+    bvh_tree sorted;
+    sorted.leaf_batch = tree.leaf_batch;
+    arena scratch;
+    sorted.build(scratch, boxes, refs_count, max_leaf_size, build);
+    delete[] boxes;
+
+    tree.assign_nodes(memory, sorted.nodes, sorted.node_count);
+    std::vector<u32> old_indices(tree.indices, tree.indices + refs_count);
+    for (u32 slot = 0; slot < refs_count; slot++) tree.indices[slot] = old_indices[sorted.indices[slot]];
+    reorder(sorted.indices);
+    if (refit_state.subtrees != NULL) tree.refit_cut(memory, refit_state);
+  }
+
+  // Takes the objects again after they moved, `objects` being the array the
+  // collider was built from: spheres and triangles are copied, instances
+  // take their transform, meshes cannot move. The tree is refit, degraded
+  // subtrees are rebuilt (bvh_tree::refit) and the whole tree when its own
+  // SAH cost degraded as much.
+  virtual BvhRefitStats refit(arena &memory, hittable **objects, const BvhRefitSettings *settings) {
+    BvhRefitStats stats = {0, 0, false, 0};
+    if (refs_count == 0) return stats;
+    aabb *boxes = new aabb[refs_count];
+    for (u32 slot = 0; slot < refs_count; slot++) {
+      primitive_ref ref = refs[slot];
+      hittable *object  = objects[tree.indices[slot]];
+      switch (ref.type) {
+        case PRIMITIVE_SPHERE:   spheres[ref.index] = *(sphere *) object; break;
+        case PRIMITIVE_TRIANGLE: triangles[ref.index] = *(triangle *) object; break;
+        case PRIMITIVE_INSTANCE: instances[ref.index].set_transform(((instance *) object)->to_world); break;
+      }
+      primitive_box(ref, boxes[slot]);
+    }
+
+    if (refit_state.subtrees == NULL) tree.refit_cut(memory, refit_state);
+    u32 *old_slots = new u32[refs_count];
+    stats = tree.refit(memory, refit_state, boxes, max_leaf_size, settings, old_slots);
+    if (stats.rebuilt > 0) reorder(old_slots);
+    delete[] old_slots;
+    delete[] boxes;
+
+    if (settings->degradation > 0 && stats.cost > settings->degradation * refit_state.built_cost) {
+      primitive_bvh::rebuild(memory);
+      stats.full_rebuild = true;
+      stats.cost         = tree.sah_cost();
+    }
+    return stats;
+  }
+
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const {
+    auto leaf_hit = [&](u32 slot, ray &closest_so_far) {
+      if (!hit_primitive(refs[slot], closest_so_far, rec)) return false;
+      closest_so_far.t_max = rec.t;
+      return true;
+    };
+    ray query = r;
+    return tree.traverse(query, leaf_hit);
+  }
+
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    if (tree.node_count == 0) return false;
+    box = tree.nodes[0].box;
+    return true;
+  }
+
+  // Closest hits of a packet of coherent rays, returns the lanes that hit.
+  // Spheres and triangles are tested on all lanes at once, meshes and
+  // instances lane by lane. Attributes are computed once per lane at the end.
+  template <u32 N>
+  inline u32 hit_packet(const ray_packet<N> &packet, f32 t_min, f32 t_max, hit_record *rec) const {
+    typedef typename packet_lanes<N>::f32v f32v;
+    f32v closest = lane_broadcast<N>(t_max);
+    f32v hit_u = {}, hit_v = {};
+    u32 hit_slot[N];
+    u32 hits = 0;
+
+    auto leaf_hit = [&](u32 slot, u32 mask) {
+      primitive_ref ref = refs[slot];
+      u32 m = 0;
+      switch (ref.type) {
+        case PRIMITIVE_SPHERE:
+          m = intersect_sphere_packet(spheres[ref.index], packet, t_min, closest, mask);
+          break;
+        case PRIMITIVE_TRIANGLE:
+          m = intersect_triangle_packet(triangles[ref.index], packet, t_min, closest, mask, hit_u, hit_v);
+          break;
+        default:
+          for (u32 lanes = mask; lanes; lanes &= lanes - 1) {
+            u32 k = __builtin_ctz(lanes);
+            ray lane = packet.get(k);
+            lane.t_min = t_min;
+            lane.t_max = closest[k];
+            if (!hit_primitive(ref, lane, rec[k])) continue;
+            closest[k] = rec[k].t;
+            m |= 1u << k;
+          }
+      }
+      for (u32 lanes = m; lanes; lanes &= lanes - 1) hit_slot[__builtin_ctz(lanes)] = slot;
+      hits |= m;
+    };
+    tree.traverse_packet(packet, t_min, closest, leaf_hit);
+
+    for (u32 lanes = hits; lanes; lanes &= lanes - 1) {
+      u32 k = __builtin_ctz(lanes);
+      primitive_ref ref = refs[hit_slot[k]];
+      ray r = packet.get(k);
+      if (ref.type == PRIMITIVE_SPHERE) {
+        const sphere &s = spheres[ref.index];
+        rec[k].t      = closest[k];
+        rec[k].p      = r.at(rec[k].t);
+        rec[k].normal = (rec[k].p - s.center) / s.radius;
+        rec[k].material_index = s.material_index;
+      } else if (ref.type == PRIMITIVE_TRIANGLE) {
+        const triangle &tri = triangles[ref.index];
+        f32 u = hit_u[k], v = hit_v[k];
+        vec3 n = (1 - u - v) * tri.normals[0] + u * tri.normals[1] + v * tri.normals[2];
+        rec[k].t      = closest[k];
+        rec[k].p      = r.at(rec[k].t);
+        rec[k].normal = normalize(n);
+        rec[k].material_index = tri.material_index;
+      }
+    }
+    return hits;
+  }
+
+  DEVICE inline bool hit_primitive(primitive_ref ref, const ray &r, hit_record &rec) const {
+    switch (ref.type) {
+      case PRIMITIVE_SPHERE:   return spheres[ref.index].sphere::hit(r, rec);
+      case PRIMITIVE_TRIANGLE: return triangles[ref.index].triangle::hit(r, rec);
+      case PRIMITIVE_MESH:     return meshes[ref.index].triangle_mesh::hit(r, rec);
+      case PRIMITIVE_INSTANCE: return instances[ref.index].instance::hit(r, rec);
+    }
+    return false;
+  }
+
+  // Moves the elements of the typed arrays and refs to a new leaf order,
+  // old_slots[slot] being the slot each one comes from
+  void reorder(const u32 *old_slots) {
+    std::vector<sphere> old_spheres(spheres, spheres + counts[PRIMITIVE_SPHERE]);
+    std::vector<triangle> old_triangles(triangles, triangles + counts[PRIMITIVE_TRIANGLE]);
+    std::vector<triangle_mesh> old_meshes(meshes, meshes + counts[PRIMITIVE_MESH]);
+    std::vector<instance> old_instances(instances, instances + counts[PRIMITIVE_INSTANCE]);
+    std::vector<primitive_ref> old_refs(refs, refs + refs_count);
+    u32 next[PRIMITIVE_TYPES] = {0};
+    for (u32 slot = 0; slot < refs_count; slot++) {
+      primitive_ref ref = old_refs[old_slots[slot]];
+      u32 index = next[ref.type]++;
+      switch (ref.type) {
+        case PRIMITIVE_SPHERE:   new (&spheres[index]) sphere(old_spheres[ref.index]); break;
+        case PRIMITIVE_TRIANGLE: new (&triangles[index]) triangle(old_triangles[ref.index]); break;
+        case PRIMITIVE_MESH:     new (&meshes[index]) triangle_mesh(old_meshes[ref.index]); break;
+        case PRIMITIVE_INSTANCE: new (&instances[index]) instance(old_instances[ref.index]); break;
+      }
+      refs[slot].type  = ref.type;
+      refs[slot].index = index;
+    }
+  }
+
+  DEVICE inline bool primitive_box(primitive_ref ref, aabb &box) const {
+    switch (ref.type) {
+      case PRIMITIVE_SPHERE:   return spheres[ref.index].sphere::bounding_box(box);
+      case PRIMITIVE_TRIANGLE: return triangles[ref.index].triangle::bounding_box(box);
+      case PRIMITIVE_MESH:     return meshes[ref.index].triangle_mesh::bounding_box(box);
+      case PRIMITIVE_INSTANCE: return instances[ref.index].instance::bounding_box(box);
+    }
+    return false;
+  }
+
+  // PRIMITIVE_TYPES for objects outside the closed set
+  static u32 primitive_type(const hittable *object) {
+    // Exact type checks, a subclass could override hit
+    if (typeid(*object) == typeid(sphere))        return PRIMITIVE_SPHERE;
+    if (typeid(*object) == typeid(triangle))      return PRIMITIVE_TRIANGLE;
+    if (typeid(*object) == typeid(triangle_mesh)) return PRIMITIVE_MESH;
+    if (typeid(*object) == typeid(instance))      return PRIMITIVE_INSTANCE;
+    return PRIMITIVE_TYPES;
+  }
+
+  static bool supports(hittable *const *objects, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+      if (primitive_type(objects[i]) == PRIMITIVE_TYPES) return false;
+    }
+    return true;
+  }
+};
+
+//--------------------------------------------------------------------------------------------------
+// primitive_bvh traversed through a W wide BVH collapsed from its binary
+// tree. The meshes, and private copies of the meshes the instances share,
+// are widened as well so the world ends up wide all the way down. Packets
+// keep the binary tree.
+template <u32 W>
+class wide_primitive_bvh : public primitive_bvh {
+public:
+  wide_bvh<W> wide;
+
+  wide_primitive_bvh(arena &memory, hittable **objects, u32 n, u32 max_leaf_size = BVH_MAX_LEAF_SIZE,
+                     const BvhBuildSettings *build = NULL)
+      : primitive_bvh(memory, objects, n, max_leaf_size, build) {
+    wide.build(memory, tree);
+    for (u32 i = 0; i < counts[PRIMITIVE_MESH]; i++) meshes[i].widen(memory, W);
+
+    std::vector<std::pair<const triangle_mesh *, triangle_mesh *>> widened;
+    for (u32 i = 0; i < counts[PRIMITIVE_INSTANCE]; i++) {
+      const triangle_mesh *shared = instances[i].mesh;
+      triangle_mesh *copy = NULL;
+      for (auto &known : widened) {
+        if (known.first == shared) copy = known.second;
+      }
+      if (copy == NULL) {
+        copy = memory.create<triangle_mesh>(*shared);
+        copy->widen(memory, W);
+        widened.push_back(std::make_pair(shared, copy));
+      }
+      instances[i].mesh = copy;
+    }
+  }
+
+  // The wide nodes are collapsed again from the rebuilt or refit binary tree
+  virtual void rebuild(arena &memory, const BvhBuildSettings *build = NULL) {
+    primitive_bvh::rebuild(memory, build);
+    wide.build(memory, tree);
+  }
+
+  virtual BvhRefitStats refit(arena &memory, hittable **objects, const BvhRefitSettings *settings) {
+    BvhRefitStats stats = primitive_bvh::refit(memory, objects, settings);
+    wide.build(memory, tree);
+    return stats;
+  }
+
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const {
+    auto leaf_hit = [&](u32 slot, ray &closest_so_far) {
+      if (!hit_primitive(refs[slot], closest_so_far, rec)) return false;
+      closest_so_far.t_max = rec.t;
+      return true;
+    };
+    ray query = r;
+    return wide.traverse(query, leaf_hit);
+  }
+};
+
+#endif
@@ -7,17 +7,20 @@ class sphere : public hittable {
 public:
   vec3 center;
   f32 radius;
-  material *mat_ptr;
+  u32 material_index;
 
   DEVICE sphere() {}
-  DEVICE sphere(vec3 cen, f32 r, material *m)
-      : center(cen), radius(r), mat_ptr(m){};
-  DEVICE virtual bool hit(const ray &r, f32 tmin, f32 tmax,
-                              hit_record &rec) const;
+  DEVICE sphere(vec3 cen, f32 r, u32 m)
+      : center(cen), radius(r), material_index(m){};
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const;
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    vec3 extent(radius, radius, radius);
+    box = aabb(center - extent, center + extent);
+    return true;
+  }
 };
 
-DEVICE bool sphere::hit(const ray &r, f32 t_min, f32 t_max,
-                            hit_record &rec) const {
+DEVICE bool sphere::hit(const ray &r, hit_record &rec) const {
 
   vec3 oc = r.origin() - center;
   f32 a = r.direction().norm_squared();
@@ -29,16 +32,16 @@ DEVICE bool sphere::hit(const ray &r, f32 t_min, f32 t_max,
     return false;
 
   f32 value = (-h - sqrt(discriminant)) / a;
-  if (!INTERVAL_SURROUND(t_min, t_max, value)) {
+  if (!INTERVAL_SURROUND(r.t_min, r.t_max, value)) {
     value = (-h + sqrt(discriminant)) / a;
-    if (!INTERVAL_SURROUND(t_min, t_max, value))
+    if (!INTERVAL_SURROUND(r.t_min, r.t_max, value))
       return false;
   }
 
   rec.t = value;
   rec.p = r.at(rec.t);
   rec.normal = (rec.p - center) / radius;
-  rec.mat_ptr = mat_ptr;
+  rec.material_index = material_index;
 
   return true;
 }
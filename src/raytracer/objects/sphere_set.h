@@ -0,0 +1,197 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "sphere.h"
+#include "../../utils/arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Spheres tested per instruction, follows the widest vector unit enabled at compile time
+#if defined(__AVX512F__)
+#define SPHERE_SET_LANES 16
+#elif defined(__AVX2__)
+#define SPHERE_SET_LANES 8
+#else
+#define SPHERE_SET_LANES 1
+#endif
+
+// Packed spheres in structure of arrays form, one ray is tested against
+// SPHERE_SET_LANES spheres at a time. Used as a BVH leaf so a whole leaf of
+// spheres costs a few vector instructions instead of one virtual call each.
+class sphere_set : public hittable {
+public:
+  f32 *center_x;
+  f32 *center_y;
+  f32 *center_z;
+  f32 *radius;
+  u32 *material_indices;
+  u32 count;
+  u32 padded_count; // multiple of SPHERE_SET_LANES, padding lanes are masked out
+
+  sphere_set(arena &memory, sphere **spheres, u32 n) {
+    count        = n;
+    padded_count = (n + SPHERE_SET_LANES - 1) / SPHERE_SET_LANES * SPHERE_SET_LANES;
+    center_x     = alloc_lanes(memory);
+    center_y     = alloc_lanes(memory);
+    center_z     = alloc_lanes(memory);
+    radius       = alloc_lanes(memory);
+    material_indices = memory.array<u32>(padded_count);
+    assign(spheres, n);
+  }
+
+  // Takes up to padded_count spheres again without allocating, after they
+  // moved or to reuse the set for another leaf
+  void assign(sphere **spheres, u32 n) {
+    count = n;
+    for (u32 i = 0; i < n; i++) {
+      center_x[i]  = spheres[i]->center.x();
+      center_y[i]  = spheres[i]->center.y();
+      center_z[i]  = spheres[i]->center.z();
+      radius[i]    = spheres[i]->radius;
+      material_indices[i] = spheres[i]->material_index;
+    }
+  }
+
+  virtual bool hit(const ray &r, hit_record &rec) const;
+
+  virtual bool bounding_box(aabb &box) const {
+    box = aabb();
+    for (u32 i = 0; i < count; i++) {
+      vec3 center(center_x[i], center_y[i], center_z[i]);
+      vec3 extent(radius[i], radius[i], radius[i]);
+      box.grow(aabb(center - extent, center + extent));
+    }
+    return count > 0;
+  }
+
+private:
+  f32 *alloc_lanes(arena &memory) {
+    f32 *lanes = memory.array<f32>(MAX(padded_count, 16u), 64);
+    memset(lanes, 0, MAX(padded_count, 16u) * sizeof(f32));
+    return lanes;
+  }
+};
+
+inline bool sphere_set::hit(const ray &r, hit_record &rec) const {
+  vec3 o = r.origin();
+  vec3 d = r.direction();
+  f32 a  = d.norm_squared();
+  f32 t_min   = r.t_min;
+  f32 closest = r.t_max;
+  i32 best    = -1;
+
+#if defined(__AVX512F__)
+  __m512 ox = _mm512_set1_ps(o.x()), oy = _mm512_set1_ps(o.y()), oz = _mm512_set1_ps(o.z());
+  __m512 dx = _mm512_set1_ps(d.x()), dy = _mm512_set1_ps(d.y()), dz = _mm512_set1_ps(d.z());
+  __m512 va = _mm512_set1_ps(a);
+  __m512 vt_min = _mm512_set1_ps(t_min);
+  for (u32 b = 0; b < padded_count; b += 16) {
+    __m512 ocx = _mm512_sub_ps(ox, _mm512_load_ps(center_x + b));
+    __m512 ocy = _mm512_sub_ps(oy, _mm512_load_ps(center_y + b));
+    __m512 ocz = _mm512_sub_ps(oz, _mm512_load_ps(center_z + b));
+    __m512 rad = _mm512_load_ps(radius + b);
+    __m512 h = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)), _mm512_mul_ps(ocz, dz));
+    __m512 oc2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)), _mm512_mul_ps(ocz, ocz));
+    __m512 c = _mm512_sub_ps(oc2, _mm512_mul_ps(rad, rad));
+    __m512 disc = _mm512_sub_ps(_mm512_mul_ps(h, h), _mm512_mul_ps(va, c));
+
+    u32 remaining = count - MIN(b, count);
+    __mmask16 lanes = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+    __mmask16 valid = _mm512_mask_cmp_ps_mask(lanes, disc, _mm512_setzero_ps(), _CMP_GT_OQ);
+    if (!valid) continue;
+
+    __m512 vclosest = _mm512_set1_ps(closest);
+    __m512 sq   = _mm512_maskz_sqrt_ps(valid, disc);
+    __m512 nh   = _mm512_sub_ps(_mm512_setzero_ps(), h);
+    __m512 t0   = _mm512_div_ps(_mm512_sub_ps(nh, sq), va);
+    __m512 t1   = _mm512_div_ps(_mm512_add_ps(nh, sq), va);
+    __mmask16 m0 = _mm512_mask_cmp_ps_mask(valid, t0, vt_min, _CMP_GT_OQ) & _mm512_cmp_ps_mask(t0, vclosest, _CMP_LT_OQ);
+    __mmask16 m1 = _mm512_mask_cmp_ps_mask(valid & ~m0, t1, vt_min, _CMP_GT_OQ) & _mm512_cmp_ps_mask(t1, vclosest, _CMP_LT_OQ);
+    __mmask16 m  = m0 | m1;
+    if (!m) continue;
+
+    __m512 t = _mm512_mask_blend_ps(m0, t1, t0);
+    t = _mm512_mask_blend_ps(m, _mm512_set1_ps(INF), t);
+    // Min tree as in the AVX2 path, with the zero masked forms over every
+    // lane: GCC 12 warns about the undefined source of the plain ones
+    const __mmask16 all = 0xFFFF;
+    __m512 t_min_lanes = _mm512_maskz_min_ps(all, t, _mm512_maskz_shuffle_f32x4(all, t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+    t_min_lanes = _mm512_maskz_min_ps(all, t_min_lanes, _mm512_maskz_shuffle_f32x4(all, t_min_lanes, t_min_lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    t_min_lanes = _mm512_maskz_min_ps(all, t_min_lanes, _mm512_maskz_shuffle_ps(all, t_min_lanes, t_min_lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+    t_min_lanes = _mm512_maskz_min_ps(all, t_min_lanes, _mm512_maskz_shuffle_ps(all, t_min_lanes, t_min_lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    __mmask16 winner = _mm512_cmp_ps_mask(t, t_min_lanes, _CMP_EQ_OQ) & m;
+    closest = _mm512_cvtss_f32(t_min_lanes);
+    best    = b + __builtin_ctz(winner);
+  }
+#elif defined(__AVX2__)
+  __m256 ox = _mm256_set1_ps(o.x()), oy = _mm256_set1_ps(o.y()), oz = _mm256_set1_ps(o.z());
+  __m256 dx = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()), dz = _mm256_set1_ps(d.z());
+  __m256 va = _mm256_set1_ps(a);
+  __m256 vt_min = _mm256_set1_ps(t_min);
+  __m256 lane_index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  for (u32 b = 0; b < padded_count; b += 8) {
+    __m256 ocx = _mm256_sub_ps(ox, _mm256_load_ps(center_x + b));
+    __m256 ocy = _mm256_sub_ps(oy, _mm256_load_ps(center_y + b));
+    __m256 ocz = _mm256_sub_ps(oz, _mm256_load_ps(center_z + b));
+    __m256 rad = _mm256_load_ps(radius + b);
+    __m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+    __m256 oc2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz));
+    __m256 c = _mm256_sub_ps(oc2, _mm256_mul_ps(rad, rad));
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(va, c));
+
+    __m256 lanes = _mm256_cmp_ps(lane_index, _mm256_set1_ps((f32)(count - MIN(b, count))), _CMP_LT_OQ);
+    __m256 valid = _mm256_and_ps(lanes, _mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GT_OQ));
+    if (_mm256_movemask_ps(valid) == 0) continue;
+
+    __m256 vclosest = _mm256_set1_ps(closest);
+    __m256 sq  = _mm256_sqrt_ps(_mm256_max_ps(disc, _mm256_setzero_ps()));
+    __m256 nh  = _mm256_sub_ps(_mm256_setzero_ps(), h);
+    __m256 t0  = _mm256_div_ps(_mm256_sub_ps(nh, sq), va);
+    __m256 t1  = _mm256_div_ps(_mm256_add_ps(nh, sq), va);
+    __m256 m0  = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t0, vt_min, _CMP_GT_OQ), _mm256_cmp_ps(t0, vclosest, _CMP_LT_OQ)));
+    __m256 m1  = _mm256_andnot_ps(m0, _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t1, vt_min, _CMP_GT_OQ), _mm256_cmp_ps(t1, vclosest, _CMP_LT_OQ))));
+    __m256 m   = _mm256_or_ps(m0, m1);
+    if (_mm256_movemask_ps(m) == 0) continue;
+
+    __m256 t = _mm256_blendv_ps(t1, t0, m0);
+    t = _mm256_blendv_ps(_mm256_set1_ps(INF), t, m);
+    __m256 t_min_lanes = _mm256_min_ps(t, _mm256_permute2f128_ps(t, t, 1));
+    t_min_lanes = _mm256_min_ps(t_min_lanes, _mm256_shuffle_ps(t_min_lanes, t_min_lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+    t_min_lanes = _mm256_min_ps(t_min_lanes, _mm256_shuffle_ps(t_min_lanes, t_min_lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    i32 winner = _mm256_movemask_ps(_mm256_and_ps(m, _mm256_cmp_ps(t, t_min_lanes, _CMP_EQ_OQ)));
+    closest = _mm256_cvtss_f32(t_min_lanes);
+    best    = b + __builtin_ctz(winner);
+  }
+#else
+  for (u32 i = 0; i < count; i++) {
+    vec3 oc = o - vec3(center_x[i], center_y[i], center_z[i]);
+    f32 h = dot(oc, d);
+    f32 c = oc.norm_squared() - radius[i] * radius[i];
+    f32 discriminant = h * h - a * c;
+    if (discriminant <= 0) continue;
+
+    f32 value = (-h - sqrt(discriminant)) / a;
+    if (!INTERVAL_SURROUND(t_min, closest, value)) {
+      value = (-h + sqrt(discriminant)) / a;
+      if (!INTERVAL_SURROUND(t_min, closest, value)) continue;
+    }
+    closest = value;
+    best    = i;
+  }
+#endif
+
+  if (best < 0) return false;
+  vec3 center(center_x[best], center_y[best], center_z[best]);
+  rec.t       = closest;
+  rec.p       = r.at(rec.t);
+  rec.normal  = (rec.p - center) / radius[best];
+  rec.material_index = material_indices[best];
+  return true;
+}
+
+#endif
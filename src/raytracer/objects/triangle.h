@@ -8,26 +8,29 @@ class triangle : public hittable {
 public:
   vec3 vertices[3];
   vec3 normals[3];
-  material *mat_ptr;
+  u32 material_index;
   bool back_culling;
 
   DEVICE triangle() {}
-  DEVICE triangle(vec3 v[3], vec3 n[3], material *m, bool b = true) {    
+  DEVICE triangle(vec3 v[3], vec3 n[3], u32 m, bool b = true) {    
     for(int i = 0; i < 3; i++)  vertices[i] = v[i];
     for(int i = 0; i < 3; i++)  normals[i]  = n[i];
-    mat_ptr  = m;
+    material_index = m;
     back_culling = b;
   }
-  DEVICE virtual bool hit(const ray &r, f32 tmin, f32 tmax, hit_record &rec) const;
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const;
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    box = aabb();
+    for(int i = 0; i < 3; i++) box.grow(vertices[i]);
+    return true;
+  }
 };
 
-DEVICE inline bool triangle::hit(const ray &r, f32 t_min, f32 t_max, hit_record &rec) const {
-
-  // Möller –Trumbore intersection algorithm for triangle
-  const vec3 &p0 = vertices[0];
-  const vec3 &p1 = vertices[1];
-  const vec3 &p2 = vertices[2];
-  
+// Möller–Trumbore intersection, shared by triangle and triangle_mesh. Returns
+// the distance and the barycentric coordinates (u, v) of p1 and p2
+DEVICE inline bool intersect_triangle(const vec3 &p0, const vec3 &p1, const vec3 &p2, const ray &r,
+                                      f32 t_min, f32 t_max, bool back_culling,
+                                      f32 &t, f32 &u, f32 &v) {
   // Find vectors for two edges sharing p0
   vec3 e1 = p1 - p0;
   vec3 e2 = p2 - p0;
@@ -45,7 +48,7 @@ DEVICE inline bool triangle::hit(const ray &r, f32 t_min, f32 t_max, hit_record
   vec3 T = r.origin() - p0;
 
   // Calculate u parameter and test bound
-  f32 u = dot(T, P) * inv_det;
+  u = dot(T, P) * inv_det;
   // The intersection lies outside of the triangle
   if (u < 0.f || u > 1.f) {
     return false;
@@ -55,11 +58,17 @@ DEVICE inline bool triangle::hit(const ray &r, f32 t_min, f32 t_max, hit_record
   vec3 Q = cross(T, e1);
 
   // Calculate V parameter and test bound
-  f32 v = dot(r.direction(), Q) * inv_det;
+  v = dot(r.direction(), Q) * inv_det;
   // The intersection lies outside of the triangle
   if (v < 0.f || u + v > 1.f) return false;
 
-  f32 t = dot(e2, Q) * inv_det;
+  t = dot(e2, Q) * inv_det;
+  return INTERVAL_SURROUND(t_min, t_max, t);
+}
+
+DEVICE inline bool triangle::hit(const ray &r, hit_record &rec) const {
+  f32 t, u, v;
+  if (!intersect_triangle(vertices[0], vertices[1], vertices[2], r, r.t_min, r.t_max, back_culling, t, u, v)) return false;
 
   const vec3 &n0 = normals[0];
   const vec3 &n1 = normals[1];
@@ -71,7 +80,7 @@ DEVICE inline bool triangle::hit(const ray &r, f32 t_min, f32 t_max, hit_record
   rec.t         = t;
   rec.p         = r.at(rec.t);
   rec.normal    = normalize(n);
-  rec.mat_ptr   = mat_ptr;
+  rec.material_index = material_index;
 
   return true;
 }
@@ -0,0 +1,96 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "triangle.h"
+#include "wide_bvh.h"
+
+// Indexed triangle mesh: vertices and normals are stored once and shared by the
+// triangles through `indices` (three per triangle). The mesh keeps its own BVH
+// over the triangles, so the world collider only sees one object per mesh.
+// The buffers are not copied, several meshes can share them, the BVH lives in
+// the arena. widen() adds a 4 or 8 wide BVH over the same leaves, which is
+// then traversed instead of the binary one.
+class triangle_mesh : public hittable {
+public:
+  const vec3 *vertices;
+  const vec3 *normals; // per vertex, NULL uses the geometric normal
+  const u32 *indices;
+  u32 triangle_count;
+  u32 material_index;
+  bool back_culling;
+  bvh_tree tree;
+  const wide_bvh<4> *wide4; // NULL unless widened
+  const wide_bvh<8> *wide8;
+
+  triangle_mesh(arena &memory, const vec3 *v, const vec3 *n, const u32 *idx, u32 count, u32 m, bool b = true)
+      : vertices(v), normals(n), indices(idx), triangle_count(count), material_index(m), back_culling(b),
+        wide4(NULL), wide8(NULL) {
+    aabb *boxes = new aabb[count];
+    for (u32 k = 0; k < count; k++) {
+      for (u32 c = 0; c < 3; c++) boxes[k].grow(vertices[indices[3 * k + c]]);
+    }
+    tree.build(memory, boxes, count);
+    delete[] boxes;
+  }
+
+  // width is 4 or 8, anything else keeps the binary BVH
+  void widen(arena &memory, u32 width) {
+    wide4 = NULL;
+    wide8 = NULL;
+    if (width == 4) {
+      wide_bvh<4> *wide = memory.create<wide_bvh<4>>();
+      wide->build(memory, tree);
+      wide4 = wide;
+    } else if (width == 8) {
+      wide_bvh<8> *wide = memory.create<wide_bvh<8>>();
+      wide->build(memory, tree);
+      wide8 = wide;
+    }
+  }
+
+  DEVICE virtual bool hit(const ray &r, hit_record &rec) const {
+    i32 hit_triangle = -1;
+    f32 hit_u, hit_v;
+    auto leaf_hit = [&](u32 slot, ray &closest_so_far) {
+      u32 k = tree.indices[slot];
+      const u32 *idx = indices + 3 * k;
+      f32 t, u, v;
+      if (!intersect_triangle(vertices[idx[0]], vertices[idx[1]], vertices[idx[2]], closest_so_far,
+                              closest_so_far.t_min, closest_so_far.t_max, back_culling, t, u, v)) return false;
+      closest_so_far.t_max = t;
+      hit_triangle = k;
+      hit_u = u;
+      hit_v = v;
+      return true;
+    };
+    ray query = r;
+    bool hit;
+    if (wide8)      hit = wide8->traverse(query, leaf_hit);
+    else if (wide4) hit = wide4->traverse(query, leaf_hit);
+    else            hit = tree.traverse(query, leaf_hit);
+    if (!hit) return false;
+
+    // Attributes are only fetched for the closest triangle
+    const u32 *idx = indices + 3 * hit_triangle;
+    vec3 n;
+    if (normals) {
+      n = (1 - hit_u - hit_v) * normals[idx[0]] + hit_u * normals[idx[1]] + hit_v * normals[idx[2]];
+    } else {
+      n = cross(vertices[idx[1]] - vertices[idx[0]], vertices[idx[2]] - vertices[idx[0]]);
+    }
+
+    rec.t       = query.t_max;
+    rec.p       = r.at(rec.t);
+    rec.normal  = normalize(n);
+    rec.material_index = material_index;
+    return true;
+  }
+
+  DEVICE virtual bool bounding_box(aabb &box) const {
+    if (tree.node_count == 0) return false;
+    box = tree.nodes[0].box;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "bvh.h"
+
+// Child references of a wide node: a node index, or a leaf packing its first
+// primitive slot and its primitive count minus one, or nothing
+#define WIDE_BVH_LEAF        0x80000000u
+#define WIDE_BVH_COUNT_SHIFT 27
+#define WIDE_BVH_COUNT_MASK  0xfu
+#define WIDE_BVH_SLOT_MASK   ((1u << WIDE_BVH_COUNT_SHIFT) - 1)
+#define WIDE_BVH_EMPTY       0xffffffffu
+
+// Node of W children with their boxes in structure of arrays form: bounds
+// holds the min x, y, z then the max x, y, z of every child. Empty children
+// have inverted boxes so no ray ever enters them.
+template <u32 W>
+struct alignas(W * sizeof(f32)) wide_bvh_node {
+  f32 bounds[6][W];
+  u32 children[W];
+};
+
+//--------------------------------------------------------------------------------------------------
+// BVH of 4 or 8 children per node collapsed from a binary bvh_tree, sharing
+// its leaf slots. A ray is tested against every child box of a node with one
+// vector sequence and enters the children hit from the nearest one, the
+// others wait on the stack with their entry distance and are skipped once a
+// closer hit is found.
+template <u32 W>
+class wide_bvh {
+public:
+  typedef typename packet_lanes<W>::f32v f32v;
+  typedef typename packet_lanes<W>::i32v i32v;
+
+  wide_bvh_node<W> *nodes;
+  u32 node_count;
+  u32 node_capacity;
+  const u32 *indices; // primitive of each leaf slot, from the binary tree
+
+  wide_bvh() : nodes(NULL), node_count(0), node_capacity(0), indices(NULL) {}
+
+  // Nodes are allocated in the arena, or written over the previous build when
+  // they fit. The binary tree must outlive the wide one.
+  void build(arena &memory, const bvh_tree &binary);
+
+  // Same contract as bvh_tree::traverse
+  template <typename LeafHit>
+  inline bool traverse(ray &query, LeafHit &leaf_hit) const;
+
+private:
+  u32 collapse(std::vector<wide_bvh_node<W>> &out, const bvh_tree &binary, u32 binary_node);
+};
+
+template <u32 W>
+inline void wide_bvh<W>::build(arena &memory, const bvh_tree &binary) {
+  indices    = binary.indices;
+  node_count = 0;
+  if (binary.node_count == 0) return;
+  if (binary.prim_count > WIDE_BVH_SLOT_MASK) {
+    fprintf(stderr, "wide_bvh: %u primitives do not fit the leaf references\n", binary.prim_count);
+    exit(1);
+  }
+
+  std::vector<wide_bvh_node<W>> out;
+  out.reserve(binary.node_count / 2 + 1);
+  collapse(out, binary, 0);
+  node_count = out.size();
+  if (node_count > node_capacity) {
+    node_capacity = node_count;
+    nodes = memory.array<wide_bvh_node<W>>(node_capacity, alignof(wide_bvh_node<W>));
+  }
+  std::copy(out.begin(), out.end(), nodes);
+}
+
+// Opens the largest interior child until the node has W children, so the
+// ones a ray is most likely to enter are tested together
+template <u32 W>
+inline u32 wide_bvh<W>::collapse(std::vector<wide_bvh_node<W>> &out, const bvh_tree &binary, u32 binary_node) {
+  u32 children[W];
+  u32 count = 0;
+  const bvh_node &top = binary.nodes[binary_node];
+  if (top.count > 0) {
+    children[count++] = binary_node;
+  } else {
+    children[count++] = binary_node + 1;
+    children[count++] = top.offset;
+  }
+  while (count < W) {
+    i32 largest = -1;
+    f32 largest_area = -1;
+    for (u32 k = 0; k < count; k++) {
+      const bvh_node &child = binary.nodes[children[k]];
+      if (child.count > 0) continue;
+      f32 area = child.box.surface_area();
+      if (area > largest_area) {
+        largest_area = area;
+        largest = k;
+      }
+    }
+    if (largest < 0) break;
+    u32 opened = children[largest];
+    children[largest]   = opened + 1;
+    children[count++]   = binary.nodes[opened].offset;
+  }
+
+  u32 node_index = out.size();
+  out.push_back(wide_bvh_node<W>());
+  for (u32 k = 0; k < W; k++) {
+    aabb box;
+    u32 reference = WIDE_BVH_EMPTY;
+    if (k < count) {
+      const bvh_node &child = binary.nodes[children[k]];
+      box = child.box;
+      if (child.count > 0) {
+        reference = WIDE_BVH_LEAF | (u32)(child.count - 1) << WIDE_BVH_COUNT_SHIFT | child.offset;
+      } else {
+        reference = collapse(out, binary, children[k]);
+      }
+    }
+    for (u32 a = 0; a < 3; a++) {
+      out[node_index].bounds[a][k]     = box.min.e[a];
+      out[node_index].bounds[3 + a][k] = box.max.e[a];
+    }
+    out[node_index].children[k] = reference;
+  }
+  return node_index;
+}
+
+template <u32 W>
+template <typename LeafHit>
+inline bool wide_bvh<W>::traverse(ray &query, LeafHit &leaf_hit) const {
+  if (node_count == 0) return false;
+
+  // The near plane of every slab is the min for a positive direction
+  f32v origin[3], inv_direction[3];
+  u32 near_plane[3], far_plane[3];
+  for (u32 a = 0; a < 3; a++) {
+    origin[a]        = lane_broadcast<W>(query.origin().e[a]);
+    inv_direction[a] = lane_broadcast<W>(query.inv_direction().e[a]);
+    near_plane[a]    = query.negative(a) ? 3 + a : a;
+    far_plane[a]     = query.negative(a) ? a : 3 + a;
+  }
+  f32v t_min_lanes = lane_broadcast<W>(query.t_min);
+
+  struct entry {
+    u32 reference;
+    f32 t_entry;
+  } stack[BVH_STACK_SIZE * (W - 1)];
+  u32 stack_size = 0;
+  u32 reference = 0;
+  bool hit_anything = false;
+
+  while (true) {
+    if (reference & WIDE_BVH_LEAF) {
+      u32 first = reference & WIDE_BVH_SLOT_MASK;
+      u32 count = ((reference >> WIDE_BVH_COUNT_SHIFT) & WIDE_BVH_COUNT_MASK) + 1;
+      for (u32 i = 0; i < count; i++) {
+        if (leaf_hit(first + i, query)) hit_anything = true;
+      }
+    } else {
+      const wide_bvh_node<W> &node = nodes[reference];
+      f32v t_near = t_min_lanes;
+      f32v t_far  = lane_broadcast<W>(query.t_max);
+      for (u32 a = 0; a < 3; a++) {
+        f32v t0 = (*(const f32v *)node.bounds[near_plane[a]] - origin[a]) * inv_direction[a];
+        f32v t1 = (*(const f32v *)node.bounds[far_plane[a]] - origin[a]) * inv_direction[a];
+        t_near = t0 > t_near ? t0 : t_near;
+        t_far  = t1 < t_far ? t1 : t_far;
+      }
+      u32 mask = lane_mask<W>(t_near <= t_far);
+
+      if (mask != 0) {
+        // Nearest child next, the others pushed from the farthest
+        entry hits[W];
+        u32 hits_count = 0;
+        for (; mask; mask &= mask - 1) {
+          u32 k = __builtin_ctz(mask);
+          entry child = {node.children[k], t_near[k]};
+          u32 j = hits_count++;
+          while (j > 0 && hits[j - 1].t_entry < child.t_entry) {
+            hits[j] = hits[j - 1];
+            j--;
+          }
+          hits[j] = child;
+        }
+        for (u32 k = 0; k + 1 < hits_count; k++) stack[stack_size++] = hits[k];
+        reference = hits[hits_count - 1].reference;
+        continue;
+      }
+    }
+
+    // Children entered beyond the closest hit so far are skipped
+    do {
+      if (stack_size == 0) return hit_anything;
+      stack_size--;
+    } while (stack[stack_size].t_entry > query.t_max);
+    reference = stack[stack_size].reference;
+  }
+}
+
+#endif
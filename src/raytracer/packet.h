@@ -0,0 +1,140 @@
+#ifndef PACKETH
+#define PACKETH
+
+#include "render.h"
+
+//--------------------------------------------------------------------------------------------------
+// Packet Tracing
+// Camera rays of neighbouring pixels are coherent: they enter the same BVH
+// nodes and hit the same primitives. The tile is walked in blocks of N pixels
+// whose camera rays are traced as one packet through primitive_bvh, sharing
+// every node visit and testing each leaf primitive on all rays at once. The
+// bounces after the first hit are incoherent and each path goes on alone.
+// Pixels that stop sampling (adaptive) or fall outside the tile are masked out
+// of the packet. Every path keeps its random stream and the packet tests use
+// the scalar arithmetic, so the image matches rayTrace.
+
+// Pixel block of a packet: 2x2, 4x2 or 4x4
+template <u32 N>
+struct packet_block {
+  static const i32 width  = N >= 8 ? 4 : 2;
+  static const i32 height = N / width;
+};
+
+template <u32 N>
+inline void packetTraceTile(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings) {
+  // Colliders without packet support trace the lanes one by one
+  const primitive_bvh *collider = dynamic_cast<const primitive_bvh *>(world->collider);
+
+  bool adaptive   = world->noise_threshold > 0;
+  i32 min_samples = adaptive ? MAX(2, MIN(world->adaptive_min_samples, world->pixel_samples)) : world->pixel_samples;
+  framebuffer *aovs = settings->aovs;
+  bool timed        = aovs && aovs->has(AOV_TIME);
+  u64 samples_taken = 0;
+  u64 rays_traced   = 0;
+
+  for (i32 by = tile.y0; by < tile.y1; by += packet_block<N>::height) {
+    for (i32 bx = tile.x0; bx < tile.x1; bx += packet_block<N>::width) {
+      vec3 col[N];
+      f32 mean[N], m2[N];
+      PixelFeatures pixel_features[N];
+      f64 block_start = timed ? aovClock() : 0;
+      u32 active = 0;
+      for (u32 k = 0; k < N; k++) {
+        i32 i = bx + k % packet_block<N>::width;
+        i32 j = by + k / packet_block<N>::width;
+        if (i < tile.x1 && j < tile.y1) active |= 1u << k;
+        col[k]  = vec3(0, 0, 0);
+        mean[k] = m2[k] = 0;
+        pixel_features[k].clear();
+      }
+
+      for (i32 s = 0; active; s++) {
+        ray_packet<N> packet;
+        randState random_states[N];
+        hit_record rec[N];
+        packet.active = active;
+        for (u32 lanes = active; lanes; lanes &= lanes - 1) {
+          u32 k = __builtin_ctz(lanes);
+          i32 i = bx + k % packet_block<N>::width;
+          i32 j = by + k / packet_block<N>::width;
+          packet.set(k, cameraRay(i, j, s, width, height, world, settings, &random_states[k]));
+        }
+
+        u32 hits = 0;
+        if (collider) {
+          hits = collider->hit_packet(packet, RAY_T_MIN, INF, rec);
+        } else {
+          for (u32 lanes = active; lanes; lanes &= lanes - 1) {
+            u32 k = __builtin_ctz(lanes);
+            ray r = packet.get(k);
+            if (world->collider->hit(r, rec[k])) hits |= 1u << k;
+          }
+        }
+
+        for (u32 lanes = active; lanes; lanes &= lanes - 1) {
+          u32 k = __builtin_ctz(lanes);
+          i32 i = bx + k % packet_block<N>::width;
+          i32 j = by + k / packet_block<N>::width;
+          path_state path = path_start(packet.get(k), j*width + i);
+          bool hitted = (hits >> k) & 1;
+          FeatureSample first_hit;
+          if (aovs) first_hit = firstHitFeatures(path.r, hitted, rec[k], world);
+          if (path_shade(path, hitted, rec[k], *world, &random_states[k])) {
+            path_trace(path, *world, world->collider, &random_states[k]);
+          }
+          rays_traced += path.depth;
+          vec3 sample = path.radiance;
+          col[k] = col[k] + sample;
+          i32 taken = s + 1;
+          if (aovs) pixel_features[k].add(sample, first_hit);
+
+          bool done = taken >= world->pixel_samples;
+          if (adaptive) {
+            f32 y     = luminance(sample);
+            f32 delta = y - mean[k];
+            mean[k]  += delta / taken;
+            m2[k]    += delta * (y - mean[k]);
+            done = done || (taken >= min_samples && pixelConverged(mean[k], m2[k], taken, world->noise_threshold));
+          }
+          if (done) {
+            writeTexturePixel(texture_data, j*width + i, col[k] / f64(taken));
+            if (aovs) aovs->set(j*width + i, col[k] / f64(taken), pixel_features[k], 0.0f);
+            samples_taken += taken;
+            active &= ~(1u << k);
+          }
+        }
+      }
+
+      // The lanes share their traversals, the block time is split by samples
+      if (timed) {
+        f64 block_seconds = aovClock() - block_start;
+        i32 block_samples = 0;
+        for (u32 k = 0; k < N; k++) block_samples += pixel_features[k].samples;
+        for (u32 k = 0; k < N; k++) {
+          i32 i = bx + k % packet_block<N>::width;
+          i32 j = by + k / packet_block<N>::width;
+          if (i >= tile.x1 || j >= tile.y1) continue;
+          aovs->plane(AOV_TIME)[j*width + i] = block_seconds * pixel_features[k].samples / block_samples;
+        }
+      }
+    }
+  }
+  if (settings->stats) {
+    settings->stats->samples += samples_taken;
+    settings->stats->rays    += rays_traced;
+  }
+}
+
+inline void packetTrace(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings) {
+  switch (settings->packet_size) {
+    case 4:  packetTraceTile<4>(texture_data, width, height, tile, world, settings); break;
+    case 8:  packetTraceTile<8>(texture_data, width, height, tile, world, settings); break;
+    case 16: packetTraceTile<16>(texture_data, width, height, tile, world, settings); break;
+    default:
+      fprintf(stderr, "packetTrace: unsupported packet size %u\n", settings->packet_size);
+      exit(1);
+  }
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef PATHH
+#define PATHH
+
+#include "materials.h"
+
+//--------------------------------------------------------------------------------------------------
+// Iterative Path Integrator
+// Shared by the CPU and CUDA renderers. A path is a loop over rays instead of
+// a recursion: its whole state between two rays fits in path_state, so a path
+// can be suspended after any bounce and resumed later, in another batch or on
+// another thread. The world type only needs materials, sky colors and the
+// depth limits, the collider is passed in since the builds store it
+// differently.
+
+typedef struct path_state {
+  ray r;           // next ray to trace
+  vec3 throughput; // attenuations and roulette weights so far
+  vec3 radiance;   // light reaching the camera, final once the path ended
+  u32 pixel;
+  i32 depth;       // rays traced so far
+} path_state;
+
+DEVICE inline path_state path_start(const ray &r, u32 pixel) {
+  path_state path;
+  path.r          = r;
+  path.throughput = vec3(1, 1, 1);
+  path.radiance   = vec3(0, 0, 0);
+  path.pixel      = pixel;
+  path.depth      = 0;
+  return path;
+}
+
+DEVICE inline vec3 sky_color(const ray &r, const vec3 &sky_color1, const vec3 &sky_color2) {
+  vec3 unit_direction = normalize(r.direction());
+  f32 t = 0.5f * (unit_direction.y() + 1.0f);
+  return (1.0f - t) * sky_color1 + t * sky_color2;
+}
+
+// Continues the path once its ray was traced, rec is the closest hit when
+// hitted. Returns false when the path ended: on the sky, absorbed, past
+// ray_max_depth or by Russian roulette after roulette_depth bounces.
+template <typename WorldType>
+DEVICE inline bool path_shade(path_state &path, bool hitted, const hit_record &rec, const WorldType &world,
+                              randState *random_state) {
+  i32 bounce = path.depth++;
+  if (!hitted) {
+    path.radiance = path.throughput * sky_color(path.r, world.sky_color1, world.sky_color2);
+    return false;
+  }
+
+  RANDOM_DIMENSION(random_state, bounce_dimension(bounce));
+  ray scattered;
+  vec3 attenuation;
+  if (!world.materials[rec.material_index].scatter(path.r, rec, attenuation, scattered, random_state)) return false;
+  if (path.depth >= world.ray_max_depth) return false;
+
+  path.throughput = path.throughput * attenuation;
+  path.r          = scattered;
+  if (world.roulette_depth > 0 && bounce >= world.roulette_depth) {
+    RANDOM_DIMENSION(random_state, bounce_dimension(bounce) + SAMPLER_ROULETTE_DIMENSION);
+    f32 weight = roulette_weight(path.throughput, RANDOM_UNIFORM(random_state));
+    if (weight == 0.0f) return false;
+    path.throughput = weight * path.throughput;
+  }
+  return true;
+}
+
+// Traces the path until it ends, its radiance is then final
+template <typename WorldType>
+DEVICE inline void path_trace(path_state &path, const WorldType &world, const hittable *collider,
+                              randState *random_state) {
+  bool going = true;
+  while (going) {
+    hit_record rec;
+    bool hitted = collider->hit(path.r, rec);
+    going = path_shade(path, hitted, rec, world, random_state);
+  }
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef PROGRESSIVEH
+#define PROGRESSIVEH
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "denoise.h"
+#include "framebuffer.h"
+#include "render.h"
+
+// Adds sample `sample` of every pixel of the tile to the accumulation buffer,
+// its first hit to pixel_features and its time to pixel_seconds when given
+inline void accumulatePass(accumulation_buffer *accumulation, PixelFeatures *pixel_features, f32 *pixel_seconds,
+                           const Tile& tile, i32 sample, World* world, const RenderSettings* settings) {
+  i32 width  = accumulation->width;
+  i32 height = accumulation->height;
+  u64 rays_traced = 0;
+  for (i32 j = tile.y0; j < tile.y1; j++) {
+    for (i32 i = tile.x0; i < tile.x1; i++) {
+      FeatureSample first_hit;
+      f64 start = pixel_seconds ? aovClock() : 0;
+      vec3 col  = pixelSample(i, j, sample, width, height, world, settings, &rays_traced, pixel_features ? &first_hit : NULL);
+      accumulation->add(j*width + i, col);
+      if (pixel_features) pixel_features[j*width + i].add(col, first_hit);
+      if (pixel_seconds) pixel_seconds[j*width + i] += aovClock() - start;
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Progressive Renderer
+// A background thread renders one sample per pixel pass after another on
+// the tile workers. After each pass the running average is resolved into
+// an RGBA8 image the display thread picks up with fetch(), so the window
+// shows a preview after the first pass and refines it until pixel_samples.
+// With settings->aovs set, the first hits are accumulated as well and the
+// channels are written after the last pass, which is shown denoised when
+// asked for.
+
+class progressive_renderer {
+public:
+  progressive_renderer(i32 width, i32 height, World* world, const RenderSettings* settings, bool denoise = false)
+      : accumulation(width, height), world(world), settings(*settings), denoise(denoise),
+        stop_requested(false), passes_done(0), dirty(false) {
+    display = (u8 *) malloc(width * height * 4);
+    memset(display, 0, width * height * 4);
+    pixel_features = NULL;
+    pixel_seconds  = NULL;
+    if (settings->aovs) {
+      pixel_features = (PixelFeatures *) malloc(width * height * sizeof(PixelFeatures));
+      for (i32 p = 0; p < width * height; p++) pixel_features[p].clear();
+    }
+    if (settings->aovs && settings->aovs->has(AOV_TIME)) {
+      pixel_seconds = (f32 *) malloc(width * height * sizeof(f32));
+      memset(pixel_seconds, 0, width * height * sizeof(f32));
+    }
+  }
+
+  ~progressive_renderer() {
+    stop();
+    free(display);
+    free(pixel_features);
+    free(pixel_seconds);
+  }
+
+  void start() {
+    start_time = std::chrono::steady_clock::now();
+    coordinator = std::thread(&progressive_renderer::run, this);
+  }
+
+  // Cancels the remaining tiles and waits for the workers
+  void stop() {
+    stop_requested = true;
+    if (coordinator.joinable()) coordinator.join();
+  }
+
+  // Copies the latest resolved pass, returns false if nothing new is ready
+  bool fetch(u8 *texture_data) {
+    std::lock_guard<std::mutex> guard(display_lock);
+    if (!dirty) return false;
+    memcpy(texture_data, display, accumulation.width * accumulation.height * 4);
+    dirty = false;
+    return true;
+  }
+
+  u32 passes() const { return passes_done; }
+  bool finished() const { return passes_done >= (u32)world->pixel_samples; }
+
+private:
+  accumulation_buffer accumulation;
+  World* world;
+  RenderSettings settings;
+  bool denoise; // needs settings.aovs to keep AOV_FEATURES
+
+  std::thread coordinator;
+  std::atomic<bool> stop_requested;
+  std::atomic<u32> passes_done;
+  std::chrono::steady_clock::time_point start_time;
+
+  std::mutex display_lock;
+  u8 *display;
+  bool dirty;
+
+  // NULL unless the settings ask for aovs
+  PixelFeatures *pixel_features;
+  f32 *pixel_seconds;
+
+  void run() {
+    i32 width  = accumulation.width;
+    i32 height = accumulation.height;
+    for (i32 sample = 0; sample < world->pixel_samples && !stop_requested; sample++) {
+      run_tiles(width, height, settings.tile_size, render_threads(&settings), [&](u32, const Tile& tile) {
+        if (!stop_requested) accumulatePass(&accumulation, pixel_features, pixel_seconds, tile, sample, world, &settings);
+      });
+      if (stop_requested) break;
+      accumulation.samples++;
+      bool last = sample + 1 == world->pixel_samples;
+      if (last && settings.aovs) {
+        for (i32 p = 0; p < width * height; p++) {
+          settings.aovs->set(p, accumulation.average(p), pixel_features[p], pixel_seconds ? pixel_seconds[p] : 0.0f);
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(display_lock);
+        if (last && denoise) denoisePass();
+        else for (i32 p = 0; p < width * height; p++) writeTexturePixel(display, p, accumulation.average(p));
+        dirty = true;
+      }
+      passes_done++;
+
+      f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+      if (sample == 0) printf("First pass after %.1f ms\n", 1000.0 * seconds);
+      if (sample + 1 == world->pixel_samples) printf("Took %f s for %d passes\n", seconds, world->pixel_samples);
+    }
+  }
+
+  // Filters the final image into display
+  void denoisePass() {
+    denoiser filter(accumulation.width, accumulation.height);
+    DenoiseSettings denoise_settings = default_denoise_settings();
+    filter.run(display, settings.aovs, &denoise_settings, render_threads(&settings));
+  }
+};
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef RENDERH
+#define RENDERH
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../utils/tile_scheduler.h"
+#include "worlds.h"
+#include "framebuffer.h"
+#include "path.h"
+
+#define DEFAULT_TILE_SIZE 32
+
+// Counters filled while rendering, shared by every worker
+typedef struct RenderStats {
+  std::atomic<u64> samples; // camera paths, one primary ray each
+  std::atomic<u64> rays;    // every ray traced against the world
+} RenderStats;
+
+// Path tracing integrator used by fullRayTrace
+typedef enum {
+  INTEGRATOR_PATH,     // one path at a time, path_trace
+  INTEGRATOR_WAVEFRONT  // batched stages over queues of paths, wavefront.h
+} Integrator;
+
+typedef struct RenderSettings {
+  Integrator integrator;
+  u32 packet_size; // camera rays traced together by the path integrator: 0 (one at a time), 4, 8 or 16
+  SamplerType sampler;
+  u32 threads;   // 0 uses every hardware thread
+  i32 tile_size;
+  u32 seed;
+  u32 frame;     // keys the random streams together with pixel and sample
+  RenderStats* stats; // optional, NULL skips the counters
+  framebuffer* aovs; // optional, the channels it keeps are written next to the texture
+} RenderSettings;
+
+inline RenderSettings default_render_settings(){
+  RenderSettings settings;
+  settings.integrator = INTEGRATOR_PATH;
+  settings.packet_size = 0;
+  settings.sampler   = SAMPLER_INDEPENDENT;
+  settings.threads   = 0;
+  settings.tile_size = DEFAULT_TILE_SIZE;
+  settings.seed      = 970;
+  settings.frame     = 0;
+  settings.stats     = NULL;
+  settings.aovs      = NULL;
+  return settings;
+}
+
+inline u32 render_threads(const RenderSettings* settings){
+  if(settings->threads > 0) return settings->threads;
+  u32 hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads > 0 ? hardware_threads : 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+// CPU Ray Tracing
+
+// Camera ray of a pixel sample, starts the sampler of its path
+inline ray cameraRay(i32 i, i32 j, i32 sample, i32 width, i32 height, World* world, const RenderSettings* settings, randState* random_state) {
+  *random_state = path_sampler(settings->sampler, settings->seed, settings->frame, i, j, width, sample);
+  f64 u = f64(i + RANDOM_UNIFORM(random_state))/ f64(width);
+  f64 v = f64(j + RANDOM_UNIFORM(random_state))/ f64(height);
+  return (world->camera)->get_ray(u, v, random_state, j*width + i);
+}
+
+// Albedo, normal and depth of the first hit of a camera ray
+inline FeatureSample firstHitFeatures(const ray &r, bool hitted, const hit_record &rec, const World* world) {
+  FeatureSample first_hit;
+  if (hitted) {
+    first_hit.albedo = world->materials[rec.material_index].albedo;
+    first_hit.normal = rec.normal;
+    first_hit.depth  = rec.t * r.direction().norm();
+  } else {
+    first_hit.albedo = sky_color(r, world->sky_color1, world->sky_color2);
+    first_hit.normal = -normalize(r.direction());
+    first_hit.depth  = FEATURE_SKY_DEPTH;
+  }
+  return first_hit;
+}
+
+// One camera path through pixel (i, j), returns its linear radiance. The
+// camera ray is traced apart so its hit can be kept in first_hit when given.
+inline vec3 pixelSample(i32 i, i32 j, i32 sample, i32 width, i32 height, World* world, const RenderSettings* settings,
+                        u64* rays_traced, FeatureSample* first_hit = NULL) {
+  randState random_state;
+  path_state path = path_start(cameraRay(i, j, sample, width, height, world, settings, &random_state), j*width + i);
+  hit_record rec;
+  bool hitted = world->collider->hit(path.r, rec);
+  if (first_hit) *first_hit = firstHitFeatures(path.r, hitted, rec, world);
+  if (path_shade(path, hitted, rec, *world, &random_state)) path_trace(path, *world, world->collider, &random_state);
+  *rays_traced += path.depth;
+  return path.radiance;
+}
+
+// Seconds on the steady clock, only read when the time channel is kept
+inline f64 aovClock() {
+  return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Gamma corrects the averaged linear color into the RGBA8 texture
+inline void writeTexturePixel(u8 *texture_data, i32 pixel_index, vec3 col) {
+  col = vec3(sqrt(col.x()), sqrt(col.y()), sqrt(col.z()));
+
+  i32 index               = pixel_index * 4;
+  texture_data[index]     = (u8)(255.0f * col.x());
+  texture_data[index + 1] = (u8)(255.0f * col.y());
+  texture_data[index + 2] = (u8)(255.0f * col.z());
+  texture_data[index + 3] = 255;
+}
+
+// Standard error of the pixel mean seen after gamma correction, d sqrt(x) = dx / (2 sqrt(x)),
+// so dark and bright pixels are held to the same visible noise
+inline bool pixelConverged(f32 mean, f32 m2, i32 samples, f32 noise_threshold) {
+  f32 variance       = m2 / (samples - 1);
+  f32 standard_error = sqrt(variance / samples);
+  return standard_error < noise_threshold * (2.0f * sqrt(MAX(mean, 0.0f)) + 1e-4f);
+}
+
+inline void wavefrontTrace(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings);
+inline void packetTrace(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings);
+
+inline void rayTrace(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings) {
+  if (settings->integrator == INTEGRATOR_WAVEFRONT) {
+    wavefrontTrace(texture_data, width, height, tile, world, settings);
+    return;
+  }
+  if (settings->packet_size > 0) {
+    packetTrace(texture_data, width, height, tile, world, settings);
+    return;
+  }
+
+  bool adaptive   = world->noise_threshold > 0;
+  i32 min_samples = adaptive ? MAX(2, MIN(world->adaptive_min_samples, world->pixel_samples)) : world->pixel_samples;
+  framebuffer *aovs = settings->aovs;
+  bool timed        = aovs && aovs->has(AOV_TIME);
+  u64 samples_taken = 0;
+  u64 rays_traced   = 0;
+
+  for (i32 j = tile.y0; j < tile.y1; j++) {
+    for (i32 i = tile.x0; i < tile.x1; i++) {
+      vec3 col(0, 0, 0);
+      // Running luminance mean and squared deviations (Welford)
+      f32 mean = 0, m2 = 0;
+      i32 s = 0;
+      PixelFeatures pixel_features;
+      pixel_features.clear();
+      f64 pixel_start = timed ? aovClock() : 0;
+
+      // Ray Tracing
+      while (s < world->pixel_samples) {
+        FeatureSample first_hit;
+        vec3 sample = pixelSample(i, j, s, width, height, world, settings, &rays_traced, aovs ? &first_hit : NULL);
+        col = col + sample;
+        s++;
+        if (aovs) pixel_features.add(sample, first_hit);
+
+        if (adaptive) {
+          f32 y     = luminance(sample);
+          f32 delta = y - mean;
+          mean     += delta / s;
+          m2       += delta * (y - mean);
+          if (s >= min_samples && pixelConverged(mean, m2, s, world->noise_threshold)) break;
+        }
+      }
+      col = col / f64(s);
+      samples_taken += s;
+
+      // Write texture data
+      writeTexturePixel(texture_data, j*width + i, col);
+      if (aovs) aovs->set(j*width + i, col, pixel_features, timed ? f32(aovClock() - pixel_start) : 0.0f);
+    }
+  }
+  if (settings->stats) {
+    settings->stats->samples += samples_taken;
+    settings->stats->rays    += rays_traced;
+  }
+}
+
+// Renders the whole image in tiles spread over the worker threads. Random
+// streams are keyed by pixel and sample, so the image is the same for any
+// thread count, tile size or scheduling order.
+inline void fullRayTrace(u8 *texture_data, i32 width, i32 height, World* world, const RenderSettings* settings) {
+  run_tiles(width, height, settings->tile_size, render_threads(settings), [&](u32, const Tile& tile) {
+    rayTrace(texture_data, width, height, tile, world, settings);
+  });
+}
+
+//--------------------------------------------------------------------------------------------------
+// Thread Count Sweep
+// Renders the same image with 1, 2, 4, ... threads up to the hardware count
+// and reports the speedup and parallel efficiency against one thread
+
+inline void renderThreadSweep(i32 width, i32 height, World* world, RenderSettings settings) {
+  u8 *texture_data = (u8 *) malloc(width * height * 4);
+  u32 max_threads  = std::thread::hardware_concurrency();
+  if (max_threads < 1) max_threads = 1;
+
+  printf("%8s %12s %10s %12s\n", "threads", "time (s)", "speedup", "efficiency");
+  f64 base_seconds = 0;
+  for (u32 threads = 1; ; threads *= 2) {
+    if (threads > max_threads) threads = max_threads;
+    settings.threads = threads;
+
+    auto start = std::chrono::steady_clock::now();
+    fullRayTrace(texture_data, width, height, world, &settings);
+    f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+    if (threads == 1) base_seconds = seconds;
+    f64 speedup = base_seconds / seconds;
+    printf("%8u %12.3f %9.2fx %11.1f%%\n", threads, seconds, speedup, 100.0 * speedup / threads);
+    if (threads == max_threads) break;
+  }
+  free(texture_data);
+}
+
+#include "wavefront.h"
+#include "packet.h"
+
+#endif
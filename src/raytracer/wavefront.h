@@ -0,0 +1,369 @@
+#ifndef WAVEFRONTH
+#define WAVEFRONTH
+
+#include "render.h"
+#include "geometry/sample_batch.h"
+
+// Paths in flight per worker, bounds the queue memory to a few MB whatever the
+// tile size and sample count
+#define WAVEFRONT_QUEUE_SIZE 16384
+
+//--------------------------------------------------------------------------------------------------
+// Wavefront Integrator
+// Instead of following one path to the end, a wave of paths advances one
+// bounce at a time through batched stages: generate camera rays, intersect
+// all of them, shade the misses with the sky and shade the hits grouped by
+// material kind. Each stage runs a tight loop over structure of arrays queues.
+// Every path keeps its own random stream, so the image matches the path
+// integrator up to floating point rounding.
+
+// A pixel sample waiting to be traced
+typedef struct {
+  u32 pixel;  // index into the tile pixels
+  u32 sample;
+} PathJob;
+
+// Per pixel running state of a tile, same accumulation as rayTrace
+typedef struct {
+  vec3 col;
+  f32 mean, m2;
+  i32 samples;
+  i32 round_end; // samples the pixel has once the current round is traced
+  bool done;
+  PixelFeatures features; // only kept when the settings ask for aovs
+} PixelState;
+
+class path_queue {
+public:
+  u32 capacity;
+  // Current ray of every path
+  f32 *origin_x, *origin_y, *origin_z;
+  f32 *direction_x, *direction_y, *direction_z;
+  // Product of the attenuations so far
+  f32 *throughput_r, *throughput_g, *throughput_b;
+  // Radiance reaching the camera once the path ends
+  f32 *radiance_r, *radiance_g, *radiance_b;
+  randState *random_states;
+  // Closest hit of the current bounce
+  f32 *hit_t;
+  vec3 *hit_point;
+  vec3 *hit_normal;
+  u32 *hit_material;
+  // First hit of every path, for the albedo, normal and depth aovs
+  FeatureSample *first_hit;
+  // Path index lists: active paths, paths per material kind and misses
+  u32 *active, *next_active, *misses;
+  u32 *shade[MATERIAL_KINDS];
+
+  path_queue(u32 n) : capacity(n) {
+    f32 **lanes[] = {&origin_x, &origin_y, &origin_z, &direction_x, &direction_y, &direction_z,
+                     &throughput_r, &throughput_g, &throughput_b, &radiance_r, &radiance_g, &radiance_b, &hit_t};
+    for (f32 **lane : lanes) *lane = (f32 *) malloc(n * sizeof(f32));
+    random_states = (randState *) malloc(n * sizeof(randState));
+    hit_point     = (vec3 *) malloc(n * sizeof(vec3));
+    hit_normal    = (vec3 *) malloc(n * sizeof(vec3));
+    hit_material  = (u32 *) malloc(n * sizeof(u32));
+    first_hit     = (FeatureSample *) malloc(n * sizeof(FeatureSample));
+    active        = (u32 *) malloc(n * sizeof(u32));
+    next_active   = (u32 *) malloc(n * sizeof(u32));
+    misses        = (u32 *) malloc(n * sizeof(u32));
+    for (u32 k = 0; k < MATERIAL_KINDS; k++) shade[k] = (u32 *) malloc(n * sizeof(u32));
+  }
+
+  ~path_queue() {
+    f32 *lanes[] = {origin_x, origin_y, origin_z, direction_x, direction_y, direction_z,
+                    throughput_r, throughput_g, throughput_b, radiance_r, radiance_g, radiance_b, hit_t};
+    for (f32 *lane : lanes) free(lane);
+    free(random_states);
+    free(hit_point);
+    free(hit_normal);
+    free(hit_material);
+    free(first_hit);
+    free(active);
+    free(next_active);
+    free(misses);
+    for (u32 k = 0; k < MATERIAL_KINDS; k++) free(shade[k]);
+  }
+
+  inline ray get_ray(u32 p) const {
+    return ray(vec3(origin_x[p], origin_y[p], origin_z[p]), vec3(direction_x[p], direction_y[p], direction_z[p]));
+  }
+
+  inline void set_ray(u32 p, const ray &r) {
+    origin_x[p] = r._origin.x();    origin_y[p] = r._origin.y();    origin_z[p] = r._origin.z();
+    direction_x[p] = r._direction.x(); direction_y[p] = r._direction.y(); direction_z[p] = r._direction.z();
+  }
+};
+
+// Stage 1: one camera ray per job, same random draws as pixelSample
+inline void wavefrontGenerate(path_queue *queue, const PathJob *jobs, u32 count, const Tile &tile,
+                              i32 width, i32 height, World *world, const RenderSettings *settings) {
+  i32 tile_width = tile.x1 - tile.x0;
+  for (u32 p = 0; p < count; p++) {
+    i32 i = tile.x0 + jobs[p].pixel % tile_width;
+    i32 j = tile.y0 + jobs[p].pixel / tile_width;
+    randState *random_state = &queue->random_states[p];
+    *random_state = path_sampler(settings->sampler, settings->seed, settings->frame, i, j, width, jobs[p].sample);
+    f64 u = f64(i + RANDOM_UNIFORM(random_state))/ f64(width);
+    f64 v = f64(j + RANDOM_UNIFORM(random_state))/ f64(height);
+    queue->set_ray(p, (world->camera)->get_ray(u, v, random_state));
+    queue->active[p] = p;
+  }
+  for (u32 p = 0; p < count; p++) {
+    queue->throughput_r[p] = 1.0f; queue->throughput_g[p] = 1.0f; queue->throughput_b[p] = 1.0f;
+    queue->radiance_r[p]   = 0.0f; queue->radiance_g[p]   = 0.0f; queue->radiance_b[p]   = 0.0f;
+  }
+}
+
+// Stage 2: closest hit of every active path, sorted into material and miss lists.
+// With first_hit set the hits are also kept for the aovs.
+inline void wavefrontIntersect(path_queue *queue, u32 active_count, World *world,
+                               u32 *shade_counts, u32 *miss_count, FeatureSample *first_hit) {
+  *miss_count = 0;
+  for (u32 k = 0; k < MATERIAL_KINDS; k++) shade_counts[k] = 0;
+
+  for (u32 a = 0; a < active_count; a++) {
+    u32 p = queue->active[a];
+    hit_record rec;
+    ray r = queue->get_ray(p);
+    bool hitted = world->collider->hit(r, rec);
+    if (first_hit) first_hit[p] = firstHitFeatures(r, hitted, rec, world);
+    if (hitted) {
+      queue->hit_t[p]        = rec.t;
+      queue->hit_point[p]    = rec.p;
+      queue->hit_normal[p]   = rec.normal;
+      queue->hit_material[p] = rec.material_index;
+      MaterialKind kind = world->materials[rec.material_index].kind;
+      queue->shade[kind][shade_counts[kind]++] = p;
+    } else {
+      queue->misses[(*miss_count)++] = p;
+    }
+  }
+}
+
+// Ends a path with the sky seen along its current direction
+inline void wavefrontSky(path_queue *queue, u32 p, World *world) {
+  vec3 direction(queue->direction_x[p], queue->direction_y[p], queue->direction_z[p]);
+  f32 t = 0.5f * (direction.y() / direction.norm() + 1.0f);
+  queue->radiance_r[p] = queue->throughput_r[p] * ((1.0f - t) * world->sky_color1.x() + t * world->sky_color2.x());
+  queue->radiance_g[p] = queue->throughput_g[p] * ((1.0f - t) * world->sky_color1.y() + t * world->sky_color2.y());
+  queue->radiance_b[p] = queue->throughput_b[p] * ((1.0f - t) * world->sky_color1.z() + t * world->sky_color2.z());
+}
+
+// Stage 3: misses
+inline void wavefrontMiss(path_queue *queue, u32 miss_count, World *world) {
+  for (u32 m = 0; m < miss_count; m++) wavefrontSky(queue, queue->misses[m], world);
+}
+
+// Russian roulette on path p once it scattered, false when it ends there
+inline bool wavefrontSurvives(path_queue *queue, u32 p, u32 dimension) {
+  randState *random_state = &queue->random_states[p];
+  RANDOM_DIMENSION(random_state, dimension + SAMPLER_ROULETTE_DIMENSION);
+  vec3 throughput(queue->throughput_r[p], queue->throughput_g[p], queue->throughput_b[p]);
+  f32 weight = roulette_weight(throughput, RANDOM_UNIFORM(random_state));
+  if (weight == 0.0f) return false;
+  queue->throughput_r[p] *= weight;
+  queue->throughput_g[p] *= weight;
+  queue->throughput_b[p] *= weight;
+  return true;
+}
+
+// Stage 4: scatter of the hits of one material kind, the scatter of that kind
+// is called directly so the whole batch runs the same inlined code
+typedef bool (material::*ScatterKind)(const ray &, const hit_record &, vec3 &, ray &, randState *) const;
+
+template <ScatterKind Scatter>
+inline void wavefrontShade(path_queue *queue, const u32 *paths, u32 count, u32 dimension, bool roulette, World *world, u32 *next_count) {
+  for (u32 s = 0; s < count; s++) {
+    u32 p = paths[s];
+    ray r_in = queue->get_ray(p);
+    hit_record rec;
+    rec.t       = queue->hit_t[p];
+    rec.p       = queue->hit_point[p];
+    rec.normal  = queue->hit_normal[p];
+    rec.material_index = queue->hit_material[p];
+
+    ray scattered;
+    vec3 attenuation;
+    const material &mat = world->materials[rec.material_index];
+    RANDOM_DIMENSION(&queue->random_states[p], dimension);
+    // Absorbed paths and paths ended by the roulette carry no light
+    if ((mat.*Scatter)(r_in, rec, attenuation, scattered, &queue->random_states[p])) {
+      queue->set_ray(p, scattered);
+      queue->throughput_r[p] *= attenuation.x();
+      queue->throughput_g[p] *= attenuation.y();
+      queue->throughput_b[p] *= attenuation.z();
+      if (!roulette || wavefrontSurvives(queue, p, dimension)) queue->next_active[(*next_count)++] = p;
+    }
+  }
+}
+
+// Stage 4 for lambertian hits: the cosine hemisphere directions of up to
+// PACKET_MAX_SIZE paths are warped at once by the batch sampler
+inline void wavefrontShadeLambertian(path_queue *queue, const u32 *paths, u32 count, u32 dimension, bool roulette, World *world, u32 *next_count) {
+  const u32 lanes = PACKET_MAX_SIZE;
+  for (u32 s = 0; s < count; s += lanes) {
+    u32 n = MIN(lanes, count - s);
+    alignas(64) f32 u1[lanes], u2[lanes], x[lanes], y[lanes], z[lanes];
+    for (u32 k = 0; k < lanes; k++) {
+      if (k >= n) {
+        u1[k] = u2[k] = 0.5f;
+        x[k] = 0.0f; y[k] = 1.0f; z[k] = 0.0f;
+        continue;
+      }
+      u32 p = paths[s + k];
+      randState *random_state = &queue->random_states[p];
+      RANDOM_DIMENSION(random_state, dimension);
+      u1[k] = RANDOM_UNIFORM(random_state);
+      u2[k] = RANDOM_UNIFORM(random_state);
+      x[k] = queue->hit_normal[p].x(); y[k] = queue->hit_normal[p].y(); z[k] = queue->hit_normal[p].z();
+    }
+    sample_cosine_hemisphere_batch<PACKET_MAX_SIZE>(u1, u2, x, y, z);
+    for (u32 k = 0; k < n; k++) {
+      u32 p = paths[s + k];
+      const vec3 &albedo = world->materials[queue->hit_material[p]].albedo;
+      queue->set_ray(p, ray(queue->hit_point[p], vec3(x[k], y[k], z[k])));
+      queue->throughput_r[p] *= albedo.x();
+      queue->throughput_g[p] *= albedo.y();
+      queue->throughput_b[p] *= albedo.z();
+      if (!roulette || wavefrontSurvives(queue, p, dimension)) queue->next_active[(*next_count)++] = p;
+    }
+  }
+}
+
+// Traces a wave of jobs to the end, the radiance of job p is left in the queue
+inline u64 wavefrontTraceWave(path_queue *queue, const PathJob *jobs, u32 count, const Tile &tile,
+                              i32 width, i32 height, World *world, const RenderSettings *settings) {
+  wavefrontGenerate(queue, jobs, count, tile, width, height, world, settings);
+
+  u64 rays_traced  = 0;
+  u32 active_count = count;
+  for (i32 depth = world->ray_max_depth; depth > 0 && active_count > 0; depth--) {
+    u32 shade_counts[MATERIAL_KINDS];
+    u32 miss_count;
+    bool camera_rays = depth == world->ray_max_depth;
+    wavefrontIntersect(queue, active_count, world, shade_counts, &miss_count,
+                       camera_rays && settings->aovs ? queue->first_hit : NULL);
+    rays_traced += active_count;
+
+    wavefrontMiss(queue, miss_count, world);
+    u32 next_count = 0;
+    u32 dimension  = bounce_dimension(world->ray_max_depth - depth);
+    bool roulette  = world->roulette_depth > 0 && world->ray_max_depth - depth >= world->roulette_depth;
+    wavefrontShadeLambertian(queue, queue->shade[MATERIAL_LAMBERTIAN], shade_counts[MATERIAL_LAMBERTIAN], dimension, roulette, world, &next_count);
+    wavefrontShade<&material::scatter_metal>(queue, queue->shade[MATERIAL_METAL], shade_counts[MATERIAL_METAL], dimension, roulette, world, &next_count);
+    wavefrontShade<&material::scatter_dielectric>(queue, queue->shade[MATERIAL_DIELECTRIC], shade_counts[MATERIAL_DIELECTRIC], dimension, roulette, world, &next_count);
+
+    u32 *swap = queue->active;
+    queue->active      = queue->next_active;
+    queue->next_active = swap;
+    active_count       = next_count;
+  }
+  // Paths still bouncing after ray_max_depth rays carry no light
+  return rays_traced;
+}
+
+// Wavefront version of rayTrace: the tile samples are traced in waves of up to
+// WAVEFRONT_QUEUE_SIZE paths. With adaptive sampling the first round takes the
+// minimum samples of every pixel, the next rounds one more sample of every
+// pixel not converged yet, so the stopping rule is the same as rayTrace.
+inline void wavefrontTrace(u8 *texture_data, i32 width, i32 height, const Tile& tile, World* world, const RenderSettings* settings) {
+  static thread_local path_queue queue_storage(WAVEFRONT_QUEUE_SIZE);
+  path_queue *queue = &queue_storage;
+
+  bool adaptive   = world->noise_threshold > 0;
+  i32 min_samples = adaptive ? MAX(2, MIN(world->adaptive_min_samples, world->pixel_samples)) : world->pixel_samples;
+  i32 tile_width  = tile.x1 - tile.x0;
+  u32 pixel_count = tile_width * (tile.y1 - tile.y0);
+  framebuffer *aovs = settings->aovs;
+  bool timed        = aovs && aovs->has(AOV_TIME);
+  f64 tile_start    = timed ? aovClock() : 0;
+
+  PixelState *pixels = (PixelState *) malloc(pixel_count * sizeof(PixelState));
+  for (u32 k = 0; k < pixel_count; k++) {
+    pixels[k].col     = vec3(0, 0, 0);
+    pixels[k].mean    = 0;
+    pixels[k].m2      = 0;
+    pixels[k].samples = 0;
+    pixels[k].done    = false;
+    pixels[k].features.clear();
+  }
+
+  PathJob *jobs = (PathJob *) malloc(WAVEFRONT_QUEUE_SIZE * sizeof(PathJob));
+  u64 samples_taken = 0;
+  u64 rays_traced   = 0;
+  bool pending      = true;
+  while (pending) {
+    pending = false;
+    for (u32 k = 0; k < pixel_count; k++) {
+      // Same bound as rayTrace: the forced minimum never goes past --spp
+      i32 round_end = pixels[k].samples == 0 ? min_samples : pixels[k].samples + 1;
+      pixels[k].round_end = MIN(round_end, world->pixel_samples);
+    }
+    // Jobs of a round in pixel then sample order, so folding the waves one
+    // after the other adds the samples of a pixel in the same order as rayTrace
+    u32 pixel  = 0;
+    i32 sample = -1;
+    while (true) {
+      u32 count = 0;
+      while (count < WAVEFRONT_QUEUE_SIZE && pixel < pixel_count) {
+        PixelState &state = pixels[pixel];
+        if (sample < 0) sample = state.samples;
+        if (state.done || sample >= state.round_end) {
+          pixel++;
+          sample = -1;
+          continue;
+        }
+        jobs[count].pixel  = pixel;
+        jobs[count].sample = sample++;
+        count++;
+      }
+      if (count == 0) break;
+
+      rays_traced += wavefrontTraceWave(queue, jobs, count, tile, width, height, world, settings);
+      for (u32 p = 0; p < count; p++) {
+        PixelState &state = pixels[jobs[p].pixel];
+        vec3 sample_color(queue->radiance_r[p], queue->radiance_g[p], queue->radiance_b[p]);
+        state.col = state.col + sample_color;
+        state.samples++;
+        if (aovs) state.features.add(sample_color, queue->first_hit[p]);
+        if (adaptive) {
+          f32 y     = luminance(sample_color);
+          f32 delta = y - state.mean;
+          state.mean += delta / state.samples;
+          state.m2   += delta * (y - state.mean);
+        }
+      }
+    }
+
+    for (u32 k = 0; k < pixel_count; k++) {
+      PixelState &state = pixels[k];
+      if (state.done) continue;
+      state.done = state.samples >= world->pixel_samples ||
+                   (adaptive && pixelConverged(state.mean, state.m2, state.samples, world->noise_threshold));
+      pending = pending || !state.done;
+    }
+  }
+
+  // Waves mix the paths of the whole tile, its time is split by samples
+  u64 tile_samples = 0;
+  for (u32 k = 0; k < pixel_count; k++) tile_samples += pixels[k].samples;
+  f64 tile_seconds = timed ? aovClock() - tile_start : 0;
+  for (u32 k = 0; k < pixel_count; k++) {
+    i32 i = tile.x0 + k % tile_width;
+    i32 j = tile.y0 + k / tile_width;
+    vec3 col = pixels[k].col / f64(pixels[k].samples);
+    writeTexturePixel(texture_data, j*width + i, col);
+    if (aovs) aovs->set(j*width + i, col, pixels[k].features, f32(tile_seconds * pixels[k].samples / tile_samples));
+  }
+  samples_taken += tile_samples;
+  free(jobs);
+  free(pixels);
+
+  if (settings->stats) {
+    settings->stats->samples += samples_taken;
+    settings->stats->rays    += rays_traced;
+  }
+}
+
+#endif
@@ -1,24 +1,56 @@
 #ifndef WORLD
+#define WORLD
 
+#include "objects/bvh.h"
 #include "objects/hittable.h"
 #include "objects/sphere.h"
 #include "objects/triangle.h"
+#include "objects/triangle_mesh.h"
+#include "objects/instance.h"
+#include "objects/primitive.h"
 
 #include "materials.h"
 #include "camera.h"
+#include "../utils/arena.h"
+
+#include <typeinfo>
+
+#define SPHERE_SWING  0.8f // radius of the circles moving spheres follow
+#define SPHERE_BOUNCE 0.5f
+
+// Acceleration structure used as the world collider
+typedef enum {
+  COLLIDER_LIST,
+  COLLIDER_BVH,
+  COLLIDER_BVH_SIMD,   // BVH with SoA sphere leaves
+  COLLIDER_PRIMITIVES, // BVH over flat primitive arrays with tagged dispatch
+  COLLIDER_WIDE4,      // COLLIDER_PRIMITIVES traversed through 4 wide nodes
+  COLLIDER_WIDE8       // and through 8 wide nodes
+} ColliderType;
 
 typedef struct World{
+  // Owns the world itself and everything below, released with it
+  arena* memory;
+
   // Objects
   hittable** objects;
   hittable* collider;
+  ColliderType collider_type;
   u32 objects_count; 
 
+  // Materials, referenced by index from the objects
+  material* materials;
+  u32 materials_count;
+
   // Camera
   Camera* camera;
   
   // Ray Variables
-  i32 pixel_samples;
-  i32 ray_max_depth;
+  i32 pixel_samples;        // samples per pixel, the maximum when sampling adaptively
+  i32 ray_max_depth;        // rays per path at most
+  i32 roulette_depth;       // bounces before Russian roulette may end a path, 0 disables it
+  i32 adaptive_min_samples; // samples taken before a pixel may stop
+  f32 noise_threshold;      // stop once the pixel error drops below it, 0 disables adaptive sampling
   
   // Sky Box
   vec3 sky_color1;
@@ -26,37 +58,71 @@ typedef struct World{
 
 } World;
 
+// Defaults for the ray variables, callers override them after building a world
+inline void init_world_sampling(World* world){
+  world->pixel_samples        = 10;
+  world->ray_max_depth        = 20;
+  world->roulette_depth       = 5;
+  world->adaptive_min_samples = 8;
+  world->noise_threshold      = 0;
+}
+
+// build NULL uses the SAH builder. NULL when the objects do not fit the collider:
+// the primitive colliders only store the closed primitive set
+inline hittable* make_collider(arena& memory, hittable** objects, u32 objects_count, ColliderType type,
+                               const BvhBuildSettings* build = NULL){
+  if(type == COLLIDER_LIST) return memory.create<hittable_list>(objects, objects_count);
+  if(type == COLLIDER_BVH_SIMD) return memory.create<bvh>(memory, objects, objects_count, BVH_MAX_LEAF_SIZE, true, build);
+  bool primitives = type == COLLIDER_PRIMITIVES || type == COLLIDER_WIDE4 || type == COLLIDER_WIDE8;
+  if(primitives && !primitive_bvh::supports(objects, objects_count)) return NULL;
+  if(type == COLLIDER_PRIMITIVES) return memory.create<primitive_bvh>(memory, objects, objects_count, BVH_MAX_LEAF_SIZE, build);
+  if(type == COLLIDER_WIDE4) return memory.create<wide_primitive_bvh<4>>(memory, objects, objects_count, BVH_MAX_LEAF_SIZE, build);
+  if(type == COLLIDER_WIDE8) return memory.create<wide_primitive_bvh<8>>(memory, objects, objects_count, BVH_MAX_LEAF_SIZE, build);
+  return memory.create<bvh>(memory, objects, objects_count, BVH_MAX_LEAF_SIZE, false, build);
+}
+
+// The world is the first allocation of its arena
+inline World* new_world(arena& memory){
+  World* world  = memory.create<World>();
+  world->memory = &memory;
+  init_world_sampling(world);
+  return world;
+}
+
 //--------------------------------------------------------------------------------------------------
 // World 1 
  
-inline World* simple_world(f32 aspect_ratio){
-  World* world    = (World*) malloc(sizeof(World));
+inline World* simple_world(arena& memory, f32 aspect_ratio, ColliderType collider = COLLIDER_BVH_SIMD){
+  World* world = new_world(memory);
+  material_table materials;
  
   world->objects_count = 20;
-  world->objects       = new hittable*[20];
+  world->objects       = memory.array<hittable*>(20);
  
   // ground
   u32 i = 0;
-  world->objects[i++]    = new sphere(vec3(0, -100.5, -1), 100, new lambertian(vec3(0.1, 0.5, 0.1)));
+  world->objects[i++]    = memory.create<sphere>(vec3(0, -100.5, -1), 100, materials.add(lambertian(vec3(0.1, 0.5, 0.1))));
    
   // spheres
-  world->objects[i++]    = new sphere(vec3(0, 0, 0), 0.5, new lambertian(vec3(0.1, 0.2, 0.5)));  
-  world->objects[i++]    = new sphere(vec3(1, 0, 0), 0.5, new metal(vec3(0.8, 0.6, 0.2), 0.0));
-  world->objects[i++]    = new sphere(vec3(-1, 0, 0), 0.5, new dielectric(1.5)); 
+  world->objects[i++]    = memory.create<sphere>(vec3(0, 0, 0), 0.5, materials.add(lambertian(vec3(0.1, 0.2, 0.5))));  
+  world->objects[i++]    = memory.create<sphere>(vec3(1, 0, 0), 0.5, materials.add(metal(vec3(0.8, 0.6, 0.2), 0.0)));
+  world->objects[i++]    = memory.create<sphere>(vec3(-1, 0, 0), 0.5, materials.add(dielectric(1.5))); 
 
   // triangle 1
   vec3 v[3] = {vec3(0, 1, 0.5), vec3(1, 0, 0.5), vec3(-1, 0, 0.5)};
   vec3 n[3] = {cross(v[0], v[1]), cross(v[0], v[1]), cross(v[0], v[1])};
-  world->objects[i++]    = new triangle(v, n, new dielectric(1.5), true);
+  world->objects[i++]    = memory.create<triangle>(v, n, materials.add(dielectric(1.5)), true);
 
   // triangle 2
   vec3 v2[3] = {vec3(0.5, 1, 1), vec3(1.5, 0, 1), vec3(-0.5, 0, 1) };
   vec3 n2[3] = {cross(v[0], v[1]), cross(v[0], v[1]), cross(v[0], v[1])}; 
-  world->objects[i++]    = new triangle(v2, n2, new lambertian(vec3(0.1, 0.2, 0.5)), true);
+  world->objects[i++]    = memory.create<triangle>(v2, n2, materials.add(lambertian(vec3(0.1, 0.2, 0.5))), true);
  
   // Collider and Sky
   world->objects_count = i;
-  world->collider      = new hittable_list(world->objects, i);  
+  world->materials     = materials.finish(memory, &world->materials_count);
+  world->collider      = make_collider(memory, world->objects, i, collider);
+  world->collider_type = collider;
   world->sky_color1    = vec3(1, 0.9, 1);
   world->sky_color2    = vec3(0.4, 0.5, 1.0);
  
@@ -67,7 +133,7 @@ inline World* simple_world(f32 aspect_ratio){
   f64 vfov          = 20;
   f64 aperture      = 0.1;
   f64 focus_dist    = 10.0;
-  world->camera     = new Camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);  
+  world->camera     = memory.create<Camera>(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);  
   
   return world;
 }
@@ -75,11 +141,12 @@ inline World* simple_world(f32 aspect_ratio){
 //--------------------------------------------------------------------------------------------------
 // World 2
 
-inline World* book_cover_world(f32 aspect_ratio, randState* random_state){
-  World* world         = (World*) malloc(sizeof(World)); 
+inline World* book_cover_world(arena& memory, f32 aspect_ratio, randState* random_state, ColliderType collider = COLLIDER_BVH_SIMD){
+  World* world = new_world(memory);
+  material_table materials;
   
-  world->objects    = new hittable*[500]; 
-  world->objects[0] = new sphere(vec3(0, -1000, 0), 1000, new lambertian(vec3(0.5, 0.5, 0.5)));
+  world->objects    = memory.array<hittable*>(500);
+  world->objects[0] = memory.create<sphere>(vec3(0, -1000, 0), 1000, materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
   
   i32 i = 1;
   for (i32 a = -11; a < 11; a++) {
@@ -91,32 +158,34 @@ inline World* book_cover_world(f32 aspect_ratio, randState* random_state){
         // Diffuse 
         if (choose_mat < 0.8) {
           vec3 albedo = random_vec3(0, 1, random_state) * random_vec3(0, 1, random_state);
-          world->objects[i++] = new sphere(center, 0.2, new lambertian(albedo));
+          world->objects[i++] = memory.create<sphere>(center, 0.2, materials.add(lambertian(albedo)));
         }
       
         // Metal
         else if (choose_mat < 0.95) {
           vec3 albedo = random_vec3(0.5, 1, random_state);
           f64 fuzz    = RANDOM_IN_RANGE(0, 0.5, random_state); 
-          world->objects[i++]   = new sphere(center, 0.2, new metal(albedo, fuzz));
+          world->objects[i++]   = memory.create<sphere>(center, 0.2, materials.add(metal(albedo, fuzz)));
         }
        
         // Glass
         else {
-          world->objects[i++] = new sphere(center, 0.2, new dielectric(1.5));
+          world->objects[i++] = memory.create<sphere>(center, 0.2, materials.add(dielectric(1.5)));
         }
       }
     }
   }
 
   // more spheres
-  world->objects[i++] = new sphere(vec3(0, 1, 0), 1.0, new dielectric(1.5));
-  world->objects[i++] = new sphere(vec3(-4, 1, 0), 1.0, new lambertian(vec3(0.4, 0.2, 0.1)));
-  world->objects[i++] = new sphere(vec3(4, 1, 0), 1.0, new metal(vec3(0.7, 0.6, 0.5), 0.0));
+  world->objects[i++] = memory.create<sphere>(vec3(0, 1, 0), 1.0, materials.add(dielectric(1.5)));
+  world->objects[i++] = memory.create<sphere>(vec3(-4, 1, 0), 1.0, materials.add(lambertian(vec3(0.4, 0.2, 0.1))));
+  world->objects[i++] = memory.create<sphere>(vec3(4, 1, 0), 1.0, materials.add(metal(vec3(0.7, 0.6, 0.5), 0.0)));
   world->objects_count = i;
 
   // Collider and Sky
-  world->collider = new hittable_list(world->objects, i);
+  world->materials = materials.finish(memory, &world->materials_count);
+  world->collider = make_collider(memory, world->objects, i, collider);
+  world->collider_type = collider;
   world->sky_color1 = vec3(1, 1, 1);
   world->sky_color2 = vec3(0.5, 0.7, 1.0);
 
@@ -127,8 +196,271 @@ inline World* book_cover_world(f32 aspect_ratio, randState* random_state){
   f64 vfov          = 20;
   f64 aperture      = 0.1;
   f64 focus_dist    = 10.0;
-  world->camera     = new Camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);  
+  world->camera     = memory.create<Camera>(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);  
   return world;
 }
 
+//--------------------------------------------------------------------------------------------------
+// World 3
+// Field of small random spheres over a ground sphere, the density stays the
+// same for any count so it can be scaled up for acceleration structure tests
+
+inline World* sphere_field_world(arena& memory, f32 aspect_ratio, u32 spheres_count, randState* random_state, ColliderType collider = COLLIDER_BVH_SIMD){
+  World* world = new_world(memory);
+  material_table materials;
+
+  world->objects    = memory.array<hittable*>(spheres_count + 1);
+  world->objects[0] = memory.create<sphere>(vec3(0, -1000, 0), 1000, materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+  f32 half_size = 0.5f * sqrt((f32)spheres_count);
+  u32 i = 1;
+  for (u32 s = 0; s < spheres_count; s++) {
+    f32 choose_mat = RANDOM_UNIFORM(random_state);
+    vec3 center(RANDOM_IN_RANGE(-half_size, half_size, random_state), 0.2, RANDOM_IN_RANGE(-half_size, half_size, random_state));
+
+    if (choose_mat < 0.8) {
+      vec3 albedo = random_vec3(0, 1, random_state) * random_vec3(0, 1, random_state);
+      world->objects[i++] = memory.create<sphere>(center, 0.2, materials.add(lambertian(albedo)));
+    }
+    else if (choose_mat < 0.95) {
+      world->objects[i++] = memory.create<sphere>(center, 0.2, materials.add(metal(random_vec3(0.5, 1, random_state), RANDOM_IN_RANGE(0, 0.5, random_state))));
+    }
+    else {
+      world->objects[i++] = memory.create<sphere>(center, 0.2, materials.add(dielectric(1.5)));
+    }
+  }
+  world->objects_count = i;
+
+  // Collider and Sky
+  world->materials  = materials.finish(memory, &world->materials_count);
+  world->collider   = make_collider(memory, world->objects, i, collider);
+  world->collider_type = collider;
+  world->sky_color1 = vec3(1, 1, 1);
+  world->sky_color2 = vec3(0.5, 0.7, 1.0);
+
+  // Camera
+  vec3 lookfrom     = vec3(13, 2, 3);
+  vec3 lookat       = vec3(0, 0, 0);
+  vec3 vup          = vec3(0, 1, 0);
+  f64 vfov          = 20;
+  f64 aperture      = 0.1;
+  f64 focus_dist    = 10.0;
+  world->camera     = memory.create<Camera>(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);
+  return world;
+}
+
+//--------------------------------------------------------------------------------------------------
+// World 4
+// Grid of instances of a sphere tessellated in triangles, a triangle heavy scene
+
+// Direction on the unit sphere, theta from the +y pole and phi around it
+inline vec3 sphere_direction(f32 theta, f32 phi){
+  return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+// Unit directions of a UV sphere grid with (stacks + 1) x (slices + 1) vertices,
+// both the normals and the vertices of a unit sphere at the origin
+inline vec3* uv_sphere_directions(arena& memory, u32 stacks, u32 slices){
+  vec3* directions = memory.array<vec3>((stacks + 1) * (slices + 1));
+  for (u32 st = 0; st <= stacks; st++) {
+    for (u32 sl = 0; sl <= slices; sl++) {
+      directions[st * (slices + 1) + sl] = sphere_direction(PI * st / stacks, 2 * PI * sl / slices);
+    }
+  }
+  return directions;
+}
+
+// Index buffer over uv_sphere_directions, returns the triangle count
+inline u32 uv_sphere_indices(arena& memory, u32 stacks, u32 slices, u32** indices){
+  u32* idx = memory.array<u32>(3 * (2 * stacks * slices - 2 * slices));
+  u32 i = 0;
+  for (u32 st = 0; st < stacks; st++) {
+    for (u32 sl = 0; sl < slices; sl++) {
+      u32 a = st * (slices + 1) + sl;
+      u32 b = a + slices + 1;
+      u32 c = b + 1;
+      u32 d = a + 1;
+
+      // Counter clockwise seen from outside, the triangles touching a pole collapse and are skipped
+      if (st != stacks - 1) { idx[i++] = a; idx[i++] = c; idx[i++] = b; }
+      if (st != 0)          { idx[i++] = a; idx[i++] = d; idx[i++] = c; }
+    }
+  }
+  *indices = idx;
+  return i / 3;
+}
+
+inline World* mesh_world(arena& memory, f32 aspect_ratio, randState* random_state, u32 spheres_per_side = 4, u32 stacks = 48, u32 slices = 96, ColliderType collider = COLLIDER_BVH){
+  World* world = new_world(memory);
+  material_table materials;
+
+  // One sphere mesh at the origin, every sphere of the grid is an instance of it
+  u32* indices;
+  u32 triangles_count = uv_sphere_indices(memory, stacks, slices, &indices);
+  vec3* normals       = uv_sphere_directions(memory, stacks, slices);
+  u32 vertices_count  = (stacks + 1) * (slices + 1);
+  vec3* vertices      = memory.array<vec3>(vertices_count);
+  for (u32 k = 0; k < vertices_count; k++) vertices[k] = 0.9f * normals[k];
+  triangle_mesh* mesh = memory.create<triangle_mesh>(memory, vertices, normals, indices, triangles_count, MATERIAL_NONE, false);
+
+  world->objects    = memory.array<hittable*>(spheres_per_side * spheres_per_side + 1);
+  world->objects[0] = memory.create<sphere>(vec3(0, -1000, 0), 1000, materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+  u32 i = 1;
+  f32 spacing = 2.5f;
+  f32 offset  = 0.5f * spacing * (spheres_per_side - 1);
+  for (u32 a = 0; a < spheres_per_side; a++) {
+    for (u32 b = 0; b < spheres_per_side; b++) {
+      vec3 center(a * spacing - offset, 0.9, b * spacing - offset);
+      f32 choose_mat = RANDOM_UNIFORM(random_state);
+
+      u32 mat;
+      if (choose_mat < 0.6)       mat = materials.add(lambertian(random_vec3(0, 1, random_state) * random_vec3(0, 1, random_state)));
+      else if (choose_mat < 0.85) mat = materials.add(metal(random_vec3(0.5, 1, random_state), RANDOM_IN_RANGE(0, 0.3, random_state)));
+      else                        mat = materials.add(dielectric(1.5));
+
+      world->objects[i++] = memory.create<instance>(mesh, center, mat);
+    }
+  }
+  world->objects_count = i;
+
+  // Collider and Sky
+  world->materials  = materials.finish(memory, &world->materials_count);
+  world->collider   = make_collider(memory, world->objects, i, collider);
+  world->collider_type = collider;
+  world->sky_color1 = vec3(1, 1, 1);
+  world->sky_color2 = vec3(0.5, 0.7, 1.0);
+
+  // Camera
+  vec3 lookfrom     = vec3(0, 1.5f * offset + 3, 2.5f * offset + 8);
+  vec3 lookat       = vec3(0, 0.5, 0);
+  vec3 vup          = vec3(0, 1, 0);
+  f64 vfov          = 30;
+  f64 aperture      = 0.0;
+  f64 focus_dist    = (lookfrom - lookat).norm();
+  world->camera     = memory.create<Camera>(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);
+  return world;
+}
+
+// Field of copies of one finely tessellated sphere, each scaled, rotated and
+// set on the ground by its own transform: the triangles and their BVH exist
+// once, the collider is the top level BVH over the instances
+inline World* instanced_world(arena& memory, f32 aspect_ratio, randState* random_state, u32 copies_per_side = 32, u32 stacks = 512, u32 slices = 1024, ColliderType collider = COLLIDER_PRIMITIVES){
+  World* world = new_world(memory);
+  material_table materials;
+
+  u32* indices;
+  u32 triangles_count = uv_sphere_indices(memory, stacks, slices, &indices);
+  vec3* normals       = uv_sphere_directions(memory, stacks, slices);
+  triangle_mesh* mesh = memory.create<triangle_mesh>(memory, normals, normals, indices, triangles_count, MATERIAL_NONE, false);
+  aabb mesh_box;
+  mesh->bounding_box(mesh_box);
+
+  world->objects    = memory.array<hittable*>(copies_per_side * copies_per_side + 1);
+  world->objects[0] = memory.create<sphere>(vec3(0, -1000, 0), 1000, materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+  u32 i = 1;
+  f32 spacing = 1.2f;
+  f32 offset  = 0.5f * spacing * (copies_per_side - 1);
+  for (u32 a = 0; a < copies_per_side; a++) {
+    for (u32 b = 0; b < copies_per_side; b++) {
+      vec3 scale     = random_vec3(0.2, 0.5, random_state);
+      vec3 axis      = random_vec3(-1, 1, random_state) + vec3(0, 0, 1e-3f);
+      f32 angle      = RANDOM_IN_RANGE(0, 2 * PI, random_state);
+      vec3 center(a * spacing - offset + RANDOM_IN_RANGE(-0.2, 0.2, random_state), 0,
+                  b * spacing - offset + RANDOM_IN_RANGE(-0.2, 0.2, random_state));
+      transform to_world = transform::translation(center) * transform::rotation(axis, angle) * transform::scaling(scale);
+      // Resting on the ground
+      to_world = transform::translation(vec3(0, -to_world.box(mesh_box).min.y(), 0)) * to_world;
+
+      f32 choose_mat = RANDOM_UNIFORM(random_state);
+      u32 mat;
+      if (choose_mat < 0.6)       mat = materials.add(lambertian(random_vec3(0, 1, random_state) * random_vec3(0, 1, random_state)));
+      else if (choose_mat < 0.85) mat = materials.add(metal(random_vec3(0.5, 1, random_state), RANDOM_IN_RANGE(0, 0.3, random_state)));
+      else                        mat = materials.add(dielectric(1.5));
+
+      world->objects[i++] = memory.create<instance>(mesh, to_world, mat);
+    }
+  }
+  world->objects_count = i;
+
+  // Collider and Sky
+  world->materials  = materials.finish(memory, &world->materials_count);
+  world->collider   = make_collider(memory, world->objects, i, collider);
+  world->collider_type = collider;
+  world->sky_color1 = vec3(1, 1, 1);
+  world->sky_color2 = vec3(0.5, 0.7, 1.0);
+
+  // Camera
+  vec3 lookfrom     = vec3(0, 0.4f * offset + 2, offset + 6);
+  vec3 lookat       = vec3(0, 0, 0.3f * offset);
+  vec3 vup          = vec3(0, 1, 0);
+  f64 vfov          = 40;
+  f64 aperture      = 0.0;
+  f64 focus_dist    = (lookfrom - lookat).norm();
+  world->camera     = memory.create<Camera>(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);
+  return world;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Animation
+
+// Centers of the objects at rest, entries of objects other than spheres are unused
+inline vec3* sphere_rest_centers(arena& memory, const World* world){
+  vec3* rest = memory.array<vec3>(world->objects_count);
+  for (u32 i = 0; i < world->objects_count; i++) {
+    if (typeid(*world->objects[i]) == typeid(sphere)) rest[i] = ((sphere*) world->objects[i])->center;
+  }
+  return rest;
+}
+
+// Spheres smaller than a unit circle around their rest center and bounce,
+// each at its own pace. The collider follows with a refit or a rebuild.
+inline void move_spheres(World* world, const vec3* rest, f32 time){
+  for (u32 i = 0; i < world->objects_count; i++) {
+    hittable* object = world->objects[i];
+    if (typeid(*object) != typeid(sphere) || ((sphere*) object)->radius >= 1) continue;
+    f32 phase = 2 * PI * (i * 0.618034f - floorf(i * 0.618034f));
+    f32 speed = 1.0f + (i * 0.754878f - floorf(i * 0.754878f));
+    f32 angle = speed * time + phase;
+    vec3 offset(SPHERE_SWING * cosf(angle), SPHERE_BOUNCE * fabsf(sinf(2 * angle)), SPHERE_SWING * sinf(angle));
+    ((sphere*) object)->center = rest[i] + offset;
+  }
+}
+
+// Updates the collider after objects moved in place. The BVHs are refit, the
+// list reads the objects themselves and needs nothing.
+inline BvhRefitStats update_collider(World* world, const BvhRefitSettings* refit){
+  primitive_bvh* primitives = dynamic_cast<primitive_bvh*>(world->collider);
+  if (primitives) return primitives->refit(*world->memory, world->objects, refit);
+  bvh* tree = dynamic_cast<bvh*>(world->collider);
+  if (tree) return tree->refit(*world->memory, world->objects, refit);
+  BvhRefitStats stats = {0, 0, false, 0};
+  return stats;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Worlds by name: simple, book, field:N (N random spheres), mesh or mesh:N (N x N triangle spheres),
+// instances or instances:N (N x N copies of a 1M triangle sphere), built in the given arena
+
+inline World* create_world(arena& memory, const char* scene, f32 aspect_ratio, randState* random_state){
+  if (strcmp(scene, "simple") == 0) return simple_world(memory, aspect_ratio);
+  if (strcmp(scene, "book") == 0)   return book_cover_world(memory, aspect_ratio, random_state);
+  if (strncmp(scene, "field:", 6) == 0) {
+    i32 spheres_count = atoi(scene + 6);
+    if (spheres_count > 0) return sphere_field_world(memory, aspect_ratio, spheres_count, random_state);
+  }
+  if (strcmp(scene, "mesh") == 0) return mesh_world(memory, aspect_ratio, random_state);
+  if (strncmp(scene, "mesh:", 5) == 0) {
+    i32 spheres_per_side = atoi(scene + 5);
+    if (spheres_per_side > 0) return mesh_world(memory, aspect_ratio, random_state, spheres_per_side);
+  }
+  if (strcmp(scene, "instances") == 0) return instanced_world(memory, aspect_ratio, random_state);
+  if (strncmp(scene, "instances:", 10) == 0) {
+    i32 copies_per_side = atoi(scene + 10);
+    if (copies_per_side > 0) return instanced_world(memory, aspect_ratio, random_state, copies_per_side);
+  }
+  return NULL;
+}
+
 #endif // !WORLD
@@ -10,12 +10,14 @@ typedef struct World {
   // Objects
   hittable **objects;  // d_list
   hittable **collider; // d_world
+  material *materials; // d_materials, indexed by the objects
 
   // Camera
   Camera **camera;
  
   i32 pixel_samples;
   i32 ray_max_depth;
+  i32 roulette_depth; // bounces before Russian roulette may end a path, 0 disables it
   
   // Sky Box
   vec3 sky_color1;
@@ -24,28 +26,36 @@ typedef struct World {
 
 #define RND (curand_uniform(&local_rand_state))
 
+// Appends a material to the device table and returns its index. The worlds
+// are built by a single thread so the table needs no synchronization.
+__device__ inline u32 add_material(material *d_materials, u32 *count, const material &mat) {
+  d_materials[*count] = mat;
+  return (*count)++;
+}
+
 //--------------------------------------------------------------------------------------------------
 // World 1
 
-__global__ void simple_world(hittable **d_list, hittable **d_world, Camera **d_camera, f32 aspect_ratio){
+__global__ void simple_world(hittable **d_list, material *d_materials, hittable **d_world, Camera **d_camera, f32 aspect_ratio){
   if (threadIdx.x == 0 && blockIdx.x == 0) {
-    d_list[0] = new sphere(vec3(0, -100.5, -1), 100, new lambertian(vec3(0.1, 0.5, 0.1)));
+    u32 m = 0;
+    d_list[0] = new sphere(vec3(0, -100.5, -1), 100, add_material(d_materials, &m, lambertian(vec3(0.1, 0.5, 0.1))));
  
     i32 i = 1;
     // spheres
-    d_list[i++] = new sphere(vec3(0, 0, 0), 0.5, new lambertian(vec3(0.1, 0.2, 0.5)));  
-    d_list[i++] = new sphere(vec3(1, 0, 0), 0.5, new metal(vec3(0.8, 0.6, 0.2), 0.0));
-    d_list[i++] = new sphere(vec3(-1, 0, 0), 0.5, new dielectric(1.5));  
+    d_list[i++] = new sphere(vec3(0, 0, 0), 0.5, add_material(d_materials, &m, lambertian(vec3(0.1, 0.2, 0.5))));  
+    d_list[i++] = new sphere(vec3(1, 0, 0), 0.5, add_material(d_materials, &m, metal(vec3(0.8, 0.6, 0.2), 0.0)));
+    d_list[i++] = new sphere(vec3(-1, 0, 0), 0.5, add_material(d_materials, &m, dielectric(1.5)));  
 
     // triangle 1
     vec3 v[3] = {vec3(0, 1, 0.5), vec3(1, 0, 0.5), vec3(-1, 0, 0.5)};
     vec3 n[3] = {cross(v[0], v[1]), cross(v[0], v[1]), cross(v[0], v[1])};
-    d_list[i++]    = new triangle(v, n, new dielectric(1.5), true);
+    d_list[i++]    = new triangle(v, n, add_material(d_materials, &m, dielectric(1.5)), true);
 
     // triangle 2
     vec3 v2[3] = {vec3(0.5, 1, 1), vec3(1.5, 0, 1), vec3(-0.5, 0, 1) };
     vec3 n2[3] = {cross(v[0], v[1]), cross(v[0], v[1]), cross(v[0], v[1])}; 
-    d_list[i++]    = new triangle(v2, n2, new lambertian(vec3(0.1, 0.2, 0.5)), true);
+    d_list[i++]    = new triangle(v2, n2, add_material(d_materials, &m, lambertian(vec3(0.1, 0.2, 0.5))), true);
  
     *d_world = new hittable_list(d_list, i);
 
@@ -64,12 +74,13 @@ __global__ void simple_world(hittable **d_list, hittable **d_world, Camera **d_c
 
 //--------------------------------------------------------------------------------------------------
 // World 2
-__global__ void book_cover_world(hittable **d_list, hittable **d_world, Camera **d_camera, f32 aspect_ratio, randState *rand_state) {
+__global__ void book_cover_world(hittable **d_list, material *d_materials, hittable **d_world, Camera **d_camera, f32 aspect_ratio, randState *rand_state) {
 
   if (threadIdx.x == 0 && blockIdx.x == 0) {
     randState local_rand_state = *rand_state;
+    u32 m = 0;
 
-    d_list[0] = new sphere(vec3(0, -1000.0, 0), 1000, new lambertian(vec3(0.5, 0.5, 0.5)));
+    d_list[0] = new sphere(vec3(0, -1000.0, 0), 1000, add_material(d_materials, &m, lambertian(vec3(0.5, 0.5, 0.5))));
 
     i32 i = 1;
     for (i32 a = -11; a < 11; a++) {
@@ -78,20 +89,20 @@ __global__ void book_cover_world(hittable **d_list, hittable **d_world, Camera *
         vec3 center(a + RND, 0.2, b + RND);
         if (choose_mat < 0.8f) {
           d_list[i++] =
-              new sphere(center, 0.2, new lambertian(vec3(RND * RND, RND * RND, RND * RND)));
+              new sphere(center, 0.2, add_material(d_materials, &m, lambertian(vec3(RND * RND, RND * RND, RND * RND))));
         } else if (choose_mat < 0.95f) {
           d_list[i++] = new sphere(center, 0.2,
-              new metal(vec3(0.5f * (1.0f + RND), 0.5f * (1.0f + RND),
+              add_material(d_materials, &m, metal(vec3(0.5f * (1.0f + RND), 0.5f * (1.0f + RND),
                              0.5f * (1.0f + RND)),
-                        0.5f * RND));
+                        0.5f * RND)));
         } else {
-          d_list[i++] = new sphere(center, 0.2, new dielectric(1.5));
+          d_list[i++] = new sphere(center, 0.2, add_material(d_materials, &m, dielectric(1.5)));
         }
       }
     }
-    d_list[i++] = new sphere(vec3(0, 1, 0), 1.0, new dielectric(1.5));
-    d_list[i++] = new sphere(vec3(-4, 1, 0), 1.0, new lambertian(vec3(0.4, 0.2, 0.1)));
-    d_list[i++] = new sphere(vec3(4, 1, 0), 1.0, new metal(vec3(0.7, 0.6, 0.5), 0.0));
+    d_list[i++] = new sphere(vec3(0, 1, 0), 1.0, add_material(d_materials, &m, dielectric(1.5)));
+    d_list[i++] = new sphere(vec3(-4, 1, 0), 1.0, add_material(d_materials, &m, lambertian(vec3(0.4, 0.2, 0.1))));
+    d_list[i++] = new sphere(vec3(4, 1, 0), 1.0, add_material(d_materials, &m, metal(vec3(0.7, 0.6, 0.5), 0.0)));
     *rand_state = local_rand_state;
     *d_world = new hittable_list(d_list, i);
 
@@ -111,7 +122,6 @@ __global__ void book_cover_world(hittable **d_list, hittable **d_world, Camera *
 
 __global__ void free_world(hittable **d_list, hittable **d_world, Camera **d_camera) {
   for (i32 i = 0; i < WORLD_SPACE; i++) {
-    delete ((sphere *)d_list[i])->mat_ptr;
     delete d_list[i];
   }
   delete *d_world;
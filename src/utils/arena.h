@@ -0,0 +1,147 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <new>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <utility>
+
+#include "utils.h"
+
+#define ARENA_CHUNK_SIZE     (64ull << 20) // address space reserved per chunk, pages are committed on first touch
+#define ARENA_HUGE_PAGE_SIZE (2ull << 20)
+#define ARENA_ALIGNMENT      16
+
+//--------------------------------------------------------------------------------------------------
+// Bump allocator owning everything a scene is made of. Memory comes from large
+// mmap chunks and is never freed piece by piece: release() unmaps every chunk
+// at once and reset() keeps the first one so the next scene reuses its pages.
+// Destructors of the objects created in it never run, so they must not own
+// memory outside the arena. Not thread safe.
+class arena {
+public:
+  size_t used;     // bytes handed out
+  size_t reserved; // bytes mapped
+
+  arena(size_t chunk = ARENA_CHUNK_SIZE, bool huge = false)
+      : used(0), reserved(0), chunk_size(chunk), huge_pages(huge), chunks(NULL), head(0), end(0) {}
+  ~arena() { release(); }
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  void *alloc(size_t size, size_t alignment = ARENA_ALIGNMENT) {
+    uintptr_t p = align_up(head, alignment);
+    if (p + size > end) {
+      grow(size + alignment);
+      p = align_up(head, alignment);
+    }
+    head  = p + size;
+    used += size;
+    return (void *) p;
+  }
+
+  template <typename T, typename... Args>
+  T *create(Args &&...args) {
+    return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Uninitialized storage for n elements
+  template <typename T>
+  T *array(size_t n, size_t alignment = alignof(T)) {
+    return (T *) alloc(MAX(n, (size_t)1) * sizeof(T), alignment);
+  }
+
+  // Drops everything but keeps the first chunk mapped for the next scene
+  void reset() {
+    while (chunks != NULL && chunks->next != NULL) {
+      chunk_header *older = chunks->next;
+      unmap(chunks);
+      chunks = older;
+    }
+    used = 0;
+    if (chunks != NULL) {
+      head = (uintptr_t)(chunks + 1);
+      end  = (uintptr_t)chunks + chunks->size;
+    }
+  }
+
+  void release() {
+    while (chunks != NULL) {
+      chunk_header *older = chunks->next;
+      unmap(chunks);
+      chunks = older;
+    }
+    used = 0;
+    head = end = 0;
+  }
+
+private:
+  // Starts every chunk, newest first
+  struct chunk_header {
+    chunk_header *next;
+    size_t size;
+  };
+
+  size_t chunk_size;
+  bool huge_pages;
+  chunk_header *chunks;
+  uintptr_t head;
+  uintptr_t end;
+
+  static uintptr_t align_up(uintptr_t p, size_t alignment) {
+    return (p + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  }
+
+  // Whatever is left in the current chunk is abandoned
+  void grow(size_t min_size) {
+    size_t page = huge_pages ? ARENA_HUGE_PAGE_SIZE : 4096;
+    size_t size = align_up(MAX(chunk_size, min_size + sizeof(chunk_header)), page);
+    chunk_header *chunk = (chunk_header *) map(size);
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks      = chunk;
+    reserved   += size;
+    head = (uintptr_t)(chunk + 1);
+    end  = (uintptr_t)chunk + size;
+  }
+
+  void *map(size_t size) {
+    void *memory = MAP_FAILED;
+    if (huge_pages) {
+#ifdef MAP_HUGETLB
+      memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+      // No huge pages reserved by the system, map aligned and ask for transparent ones
+      if (memory == MAP_FAILED) memory = map_aligned(size, ARENA_HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+      if (memory != MAP_FAILED) madvise(memory, size, MADV_HUGEPAGE);
+#endif
+    } else {
+      memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (memory == MAP_FAILED) {
+      fprintf(stderr, "arena: failed to map %zu bytes\n", size);
+      exit(1);
+    }
+    return memory;
+  }
+
+  static void *map_aligned(size_t size, size_t alignment) {
+    void *memory = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return memory;
+    uintptr_t start   = (uintptr_t)memory;
+    uintptr_t aligned = align_up(start, alignment);
+    if (aligned > start) munmap(memory, aligned - start);
+    if (start + alignment > aligned) munmap((void *)(aligned + size), start + alignment - aligned);
+    return (void *)aligned;
+  }
+
+  void unmap(chunk_header *chunk) {
+    reserved -= chunk->size;
+    munmap(chunk, chunk->size);
+  }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef EXR_H
+#define EXR_H
+
+#include <algorithm>
+#include <string.h>
+
+#include "utils.h"
+
+//--------------------------------------------------------------------------------------------------
+// OpenEXR writer for f32 channels: a single part scanline file without
+// compression, which compositing tools and OpenImageIO read as layers named
+// by the part of the channel names before the dot. Values are written in the
+// byte order of the host, EXR is little endian like x86 and ARM.
+
+typedef struct ExrChannel {
+  const char *name; // e.g. "albedo.R"
+  const f32 *data;  // width * height values, row 0 at the bottom like the textures
+} ExrChannel;
+
+inline void exr_attribute(FILE *file, const char *name, const char *type, u32 size, const void *value) {
+  fwrite(name, 1, strlen(name) + 1, file);
+  fwrite(type, 1, strlen(type) + 1, file);
+  fwrite(&size, sizeof(size), 1, file);
+  fwrite(value, 1, size, file);
+}
+
+// Returns false when the file cannot be written
+inline bool write_exr(const char *path, i32 width, i32 height, const ExrChannel *channels, u32 count) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) return false;
+
+  // Readers expect the channels sorted by name, in the list and in every line
+  ExrChannel *sorted = (ExrChannel *) malloc(count * sizeof(ExrChannel));
+  memcpy(sorted, channels, count * sizeof(ExrChannel));
+  std::sort(sorted, sorted + count, [](const ExrChannel &a, const ExrChannel &b) { return strcmp(a.name, b.name) < 0; });
+
+  const u32 magic = 20000630, version = 2;
+  fwrite(&magic, sizeof(magic), 1, file);
+  fwrite(&version, sizeof(version), 1, file);
+
+  // Channel list: name, pixel type (2 is FLOAT), linear flag, 3 reserved bytes, x and y sampling
+  u32 list_size = 1;
+  for (u32 c = 0; c < count; c++) list_size += strlen(sorted[c].name) + 1 + 16;
+  u8 *list = (u8 *) malloc(list_size);
+  u8 *cursor = list;
+  for (u32 c = 0; c < count; c++) {
+    const i32 description[4] = {2, 0, 1, 1};
+    memcpy(cursor, sorted[c].name, strlen(sorted[c].name) + 1);
+    cursor += strlen(sorted[c].name) + 1;
+    memcpy(cursor, description, sizeof(description));
+    cursor += sizeof(description);
+  }
+  *cursor = 0;
+  exr_attribute(file, "channels", "chlist", list_size, list);
+  free(list);
+
+  const u8 no_compression = 0, increasing_y = 0;
+  const i32 window[4] = {0, 0, width - 1, height - 1};
+  const f32 aspect = 1.0f, center[2] = {0.0f, 0.0f}, screen_width = 1.0f;
+  exr_attribute(file, "compression", "compression", 1, &no_compression);
+  exr_attribute(file, "dataWindow", "box2i", sizeof(window), window);
+  exr_attribute(file, "displayWindow", "box2i", sizeof(window), window);
+  exr_attribute(file, "lineOrder", "lineOrder", 1, &increasing_y);
+  exr_attribute(file, "pixelAspectRatio", "float", sizeof(aspect), &aspect);
+  exr_attribute(file, "screenWindowCenter", "v2f", sizeof(center), center);
+  exr_attribute(file, "screenWindowWidth", "float", sizeof(screen_width), &screen_width);
+  fputc(0, file);
+
+  // Offset table then one block per line: line number, byte count, then the
+  // line of every channel. Line 0 is the top of the image.
+  u64 line_bytes = (u64)width * count * sizeof(f32);
+  u64 offset     = (u64)ftell(file) + (u64)height * sizeof(u64);
+  for (i32 y = 0; y < height; y++) {
+    fwrite(&offset, sizeof(offset), 1, file);
+    offset += 2 * sizeof(i32) + line_bytes;
+  }
+  for (i32 y = 0; y < height; y++) {
+    i32 block[2] = {y, (i32)line_bytes};
+    fwrite(block, sizeof(block), 1, file);
+    for (u32 c = 0; c < count; c++) {
+      fwrite(sorted[c].data + (u64)(height - 1 - y) * width, sizeof(f32), width, file);
+    }
+  }
+
+  free(sorted);
+  bool written = !ferror(file);
+  return fclose(file) == 0 && written;
+}
+
+#endif
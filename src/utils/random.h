@@ -0,0 +1,53 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "types.h"
+
+// PCG32 generator (O'Neill, pcg-random.org): 16 bytes of state, no shared
+// tables, so every path can carry its own copy on the stack
+class pcg32 {
+public:
+  u64 state;
+  u64 inc;
+
+  pcg32() : pcg32(0) {}
+  pcg32(u64 seed, u64 sequence = 0) {
+    state = 0;
+    inc   = (sequence << 1u) | 1u;
+    next_u32();
+    state += seed;
+    next_u32();
+  }
+
+  inline u32 next_u32() {
+    u64 old = state;
+    state   = old * 6364136223846793005ULL + inc;
+    u32 xorshifted = (u32)(((old >> 18u) ^ old) >> 27u);
+    u32 rot        = (u32)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+  }
+
+  // Uniform in [0, 1) from the top 24 bits
+  inline f32 next_f32() { return (next_u32() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// SplitMix64 finalizer, turns counters into well mixed seeds
+inline u64 hash_u64(u64 x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Counter based stream for one path: the generator only depends on
+// (seed, frame, pixel, sample) so images do not depend on which thread
+// renders a pixel or in which order. Bounces draw from the stream in
+// order, which is fixed for a given path. The sample picks the stream and
+// is mixed into the state too: streams started from the same state are
+// correlated.
+inline pcg32 path_rand_state(u32 seed, u32 frame, u32 pixel, u32 sample) {
+  u64 key = hash_u64(((u64)frame << 32 | pixel) ^ hash_u64(seed));
+  return pcg32(hash_u64(key ^ sample), sample);
+}
+
+#endif
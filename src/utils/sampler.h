@@ -0,0 +1,327 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <math.h>
+#include <vector>
+
+#include "random.h"
+
+// Dimension layout of a path: the camera takes the pixel jitter (0, 1) and the
+// lens (2, 3), then every bounce starts a block of its own. Scatter functions
+// draw a fixed number of samples, so a dimension means the same thing in every
+// path and the sequences stay stratified across the samples of a pixel.
+#define SAMPLER_CAMERA_DIMENSIONS 4
+#define SAMPLER_BOUNCE_DIMENSIONS 4
+#define SAMPLER_ROULETTE_DIMENSION 3 // last of a bounce block, after the scatter samples
+
+#define SAMPLER_HALTON_DIMENSIONS 128 // past it the Halton sampler draws independent samples
+#define BLUE_NOISE_BITS           6
+#define BLUE_NOISE_SIZE           (1 << BLUE_NOISE_BITS)
+#define BLUE_NOISE_SEED           0x5eedb1eu
+
+// First dimension of the scatter after `bounce` rays, 0 being the camera ray
+inline u32 bounce_dimension(u32 bounce) {
+  return SAMPLER_CAMERA_DIMENSIONS + bounce * SAMPLER_BOUNCE_DIMENSIONS;
+}
+
+typedef enum {
+  SAMPLER_INDEPENDENT, // PCG32 stream per path, plain Monte Carlo
+  SAMPLER_SOBOL,       // Owen-scrambled Sobol, shuffled per pixel
+  SAMPLER_HALTON,      // Owen-scrambled Halton, scrambled per pixel
+  SAMPLER_BLUE_NOISE,  // one Owen-scrambled Sobol sequence shifted per pixel by a blue noise mask
+  SAMPLER_TYPES
+} SamplerType;
+
+inline u32 hash_u32(u32 a, u32 b) { return (u32)hash_u64((u64)a << 32 | b); }
+
+inline f32 unit_f32(u32 x) { return (x >> 8) * (1.0f / 16777216.0f); }
+
+//--------------------------------------------------------------------------------------------------
+// Owen-scrambled Sobol (Burley, Practical Hash-based Owen Scrambling, 2020).
+// Dimensions are padded in blocks of 4 Sobol dimensions, every block with its
+// own scramble and index shuffle.
+
+// Direction numbers of the first 4 Sobol dimensions (Joe and Kuo)
+struct sobol_directions {
+  u32 v[4][32];
+
+  sobol_directions() {
+    for (u32 i = 0; i < 32; i++) v[0][i] = 1u << (31 - i);
+    const u32 degree[4] = {0, 1, 2, 3};
+    const u32 a[4]      = {0, 0, 1, 1};
+    const u32 m[4][3]   = {{0, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+    for (u32 d = 1; d < 4; d++) {
+      u32 s = degree[d];
+      for (u32 i = 0; i < s; i++) v[d][i] = m[d][i] << (31 - i);
+      for (u32 i = s; i < 32; i++) {
+        v[d][i] = v[d][i - s] ^ (v[d][i - s] >> s);
+        for (u32 k = 1; k < s; k++) v[d][i] ^= ((a[d] >> (s - 1 - k)) & 1) * v[d][i - k];
+      }
+    }
+  }
+};
+
+inline const sobol_directions &sobol_table() {
+  static const sobol_directions table;
+  return table;
+}
+
+inline u32 sobol(u32 index, u32 dimension) {
+  const u32 *v = sobol_table().v[dimension];
+  u32 x = 0;
+  for (; index; index &= index - 1) x ^= v[__builtin_ctz(index)];
+  return x;
+}
+
+inline u32 reverse_bits(u32 x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+  x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+inline u32 laine_karras_permutation(u32 x, u32 seed) {
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return x;
+}
+
+inline u32 nested_uniform_scramble(u32 x, u32 seed) {
+  return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// Sobol point of a block already shuffled by the caller, see sampler::sequence_f32
+inline u32 owen_sobol(u32 index, u32 dimension, u32 block_seed) {
+  return nested_uniform_scramble(sobol(index, dimension % 4), hash_u32(block_seed, dimension % 4));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Owen-scrambled Halton: radical inverse in the prime base of the dimension,
+// each digit shifted by a hash of the digits before it
+
+struct halton_primes {
+  u32 p[SAMPLER_HALTON_DIMENSIONS];
+
+  halton_primes() {
+    u32 count = 0;
+    for (u32 n = 2; count < SAMPLER_HALTON_DIMENSIONS; n++) {
+      bool prime = true;
+      for (u32 k = 0; k < count && p[k] * p[k] <= n; k++) prime = prime && n % p[k] != 0;
+      if (prime) p[count++] = n;
+    }
+  }
+};
+
+inline u32 halton_base(u32 dimension) {
+  static const halton_primes primes;
+  return primes.p[dimension];
+}
+
+inline f32 owen_halton(u32 index, u32 dimension, u32 seed) {
+  u32 base   = halton_base(dimension);
+  f64 scale  = 1.0 / base;
+  f64 factor = scale;
+  f64 value  = 0;
+  u64 prefix = hash_u64((u64)seed << 32 | dimension);
+  while (index > 0) {
+    u32 digit = index % base;
+    index /= base;
+    value  += ((digit + hash_u64(prefix) % base) % base) * factor;
+    prefix  = hash_u64(prefix ^ (digit + 1));
+    factor *= scale;
+  }
+  // Past the index every digit is 0 and its scrambled digits are independent
+  // and uniform, so the tail is one uniform value over the last digit range
+  value += (hash_u64(prefix) >> 11) * (1.0 / 9007199254740992.0) * factor * base;
+  return MIN((f32)value, 0.99999994f);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Blue noise dithered sampling (Georgiev and Fajardo, 2016): all pixels share
+// one low discrepancy sequence and each pixel shifts it (mod 1) by the value
+// of a blue noise mask, so the error left at low sample counts is pushed to
+// high frequencies. Every dimension reads the mask at its own offset.
+
+// Ranks of a void and cluster pattern (Ulichney, 1993), built on first use
+struct blue_noise_mask {
+  f32 values[BLUE_NOISE_SIZE * BLUE_NOISE_SIZE];
+
+  blue_noise_mask() {
+    const u32 size = BLUE_NOISE_SIZE;
+    const u32 n    = size * size;
+    const f32 sigma = 1.9f;
+
+    // Toroidal gaussian energy of a point at the origin
+    std::vector<f32> kernel(n);
+    for (u32 y = 0; y < size; y++) {
+      for (u32 x = 0; x < size; x++) {
+        f32 dx = (f32)MIN(x, size - x);
+        f32 dy = (f32)MIN(y, size - y);
+        kernel[y * size + x] = expf(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+      }
+    }
+
+    std::vector<f32> energy(n, 0.0f);
+    std::vector<u8> pattern(n, 0);
+    std::vector<u32> rank(n);
+    auto toggle = [&](u32 p, f32 sign) {
+      pattern[p] = sign > 0;
+      u32 px = p % size, py = p / size;
+      for (u32 q = 0; q < n; q++) {
+        u32 dx = (q % size - px) & (size - 1);
+        u32 dy = (q / size - py) & (size - 1);
+        energy[q] += sign * kernel[dy * size + dx];
+      }
+    };
+    // Densest point of the pattern (value 1) or emptiest spot (value 0)
+    auto extreme = [&](u8 value) {
+      u32 best = 0;
+      f32 best_energy = value ? -INF : INF;
+      for (u32 q = 0; q < n; q++) {
+        if (pattern[q] != value) continue;
+        if (value ? energy[q] > best_energy : energy[q] < best_energy) {
+          best = q;
+          best_energy = energy[q];
+        }
+      }
+      return best;
+    };
+
+    // Random initial points, then moved from the tightest cluster to the
+    // largest void until that stops changing anything
+    pcg32 rng(BLUE_NOISE_SEED);
+    u32 ones = 0;
+    while (ones < n / 10) {
+      u32 p = rng.next_u32() % n;
+      if (pattern[p]) continue;
+      toggle(p, 1);
+      ones++;
+    }
+    for (u32 step = 0; step < n; step++) {
+      u32 cluster = extreme(1);
+      toggle(cluster, -1);
+      u32 hole = extreme(0);
+      toggle(hole, 1);
+      if (hole == cluster) break;
+    }
+    std::vector<u8> initial_pattern = pattern;
+    std::vector<f32> initial_energy = energy;
+
+    // Ranks below the initial points: remove tightest clusters
+    for (u32 r = ones; r > 0; r--) {
+      u32 cluster = extreme(1);
+      toggle(cluster, -1);
+      rank[cluster] = r - 1;
+    }
+    // Ranks above: fill largest voids
+    pattern = initial_pattern;
+    energy  = initial_energy;
+    for (u32 r = ones; r < n; r++) {
+      u32 hole = extreme(0);
+      toggle(hole, 1);
+      rank[hole] = r;
+    }
+
+    for (u32 p = 0; p < n; p++) values[p] = (rank[p] + 0.5f) / n;
+  }
+};
+
+inline const blue_noise_mask &blue_noise() {
+  static const blue_noise_mask mask;
+  return mask;
+}
+
+// Mask value of a pixel for a dimension, offsets follow the R2 sequence
+inline f32 blue_noise_value(u32 x, u32 y, u32 dimension) {
+  // 0.7548776662 and 0.5698402910 in 32 bit fixed point, wrapping is the mod 1
+  u32 ox = (dimension * 3242174889u) >> (32 - BLUE_NOISE_BITS);
+  u32 oy = (dimension * 2447445414u) >> (32 - BLUE_NOISE_BITS);
+  u32 mx = (x + ox) & (BLUE_NOISE_SIZE - 1);
+  u32 my = (y + oy) & (BLUE_NOISE_SIZE - 1);
+  return blue_noise().values[my * BLUE_NOISE_SIZE + mx];
+}
+
+//--------------------------------------------------------------------------------------------------
+// Samples of one path, indexed by dimension. It is the randState of the CPU
+// renderer: next_f32 returns the next dimension, set_dimension jumps to the
+// start of a block. The independent sampler ignores dimensions and draws from
+// its PCG stream, which also seeds scenes and benchmarks.
+
+class sampler {
+public:
+  pcg32 rng;
+  u32 type;
+  u32 sample;
+  u32 dimension;
+  u32 seed;
+  u32 x, y;
+  // Sobol block of the last dimension: its scramble seed and shuffled index
+  u32 block;
+  u32 block_seed;
+  u32 block_index;
+
+  sampler() : sampler(0) {}
+  sampler(u64 rng_seed, u64 sequence = 0)
+      : rng(rng_seed, sequence), type(SAMPLER_INDEPENDENT), sample(0), dimension(0), seed(0), x(0), y(0),
+        block(~0u), block_seed(0), block_index(0) {}
+
+  inline f32 next_f32() {
+    if (type == SAMPLER_INDEPENDENT) return rng.next_f32();
+    return sequence_f32(dimension++);
+  }
+
+  inline u32 next_u32() { return rng.next_u32(); }
+
+  inline void set_dimension(u32 d) { dimension = d; }
+
+private:
+  // Blocks are consumed in order, so their seed and index are computed once
+  inline void enter_block(u32 d) {
+    if (d / 4 == block) return;
+    block      = d / 4;
+    block_seed = hash_u32(seed, block);
+    // The blue noise sequence keeps the sample order, every pixel walks the same points
+    block_index = type == SAMPLER_BLUE_NOISE ? sample : nested_uniform_scramble(sample, block_seed);
+  }
+
+  inline f32 sequence_f32(u32 d) {
+    switch (type) {
+      case SAMPLER_SOBOL:
+        enter_block(d);
+        return unit_f32(owen_sobol(block_index, d, block_seed));
+      case SAMPLER_HALTON:
+        if (d < SAMPLER_HALTON_DIMENSIONS) return owen_halton(sample, d, seed);
+        return rng.next_f32();
+      case SAMPLER_BLUE_NOISE: {
+        enter_block(d);
+        f32 value = unit_f32(owen_sobol(block_index, d, block_seed)) + blue_noise_value(x, y, d);
+        return value < 1.0f ? value : value - 1.0f;
+      }
+    }
+    return rng.next_f32();
+  }
+};
+
+// Sampler of sample `sample` of pixel (x, y). The independent streams are the
+// same as path_rand_state, the sequences are scrambled per pixel except the
+// blue noise one that is shared by the whole frame.
+inline sampler path_sampler(SamplerType type, u32 seed, u32 frame, u32 x, u32 y, u32 width, u32 sample) {
+  u32 pixel = y * width + x;
+  sampler s;
+  s.rng       = path_rand_state(seed, frame, pixel, sample);
+  s.type      = type;
+  s.sample    = sample;
+  s.dimension = 0;
+  s.block     = ~0u;
+  s.x         = x;
+  s.y         = y;
+  if (type == SAMPLER_BLUE_NOISE) s.seed = hash_u32(seed, frame);
+  else                            s.seed = (u32)hash_u64(((u64)frame << 32 | pixel) ^ hash_u64(seed));
+  return s;
+}
+
+#endif
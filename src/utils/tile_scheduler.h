@@ -0,0 +1,95 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+
+// Image region [x0, x1) x [y0, y1)
+typedef struct {
+  i32 x0, y0;
+  i32 x1, y1;
+} Tile;
+
+// Splits an image in tiles dealt in contiguous runs to per worker deques.
+// Workers pop from the back of their own deque and, once it is empty, steal
+// from the front of the others so they take the tiles farthest from the owner.
+class tile_scheduler {
+public:
+  tile_scheduler(i32 width, i32 height, i32 tile_size, u32 workers_count)
+      : queues(workers_count) {
+    std::vector<Tile> tiles;
+    for (i32 y = 0; y < height; y += tile_size) {
+      for (i32 x = 0; x < width; x += tile_size) {
+        Tile tile = {x, y, x + tile_size, y + tile_size};
+        if (tile.x1 > width) tile.x1 = width;
+        if (tile.y1 > height) tile.y1 = height;
+        tiles.push_back(tile);
+      }
+    }
+
+    // Owners consume from the back, push in reverse so they walk in scan order
+    size_t per_worker = (tiles.size() + workers_count - 1) / workers_count;
+    for (u32 w = 0; w < workers_count; w++) {
+      size_t begin = MIN(w * per_worker, tiles.size());
+      size_t end = MIN(begin + per_worker, tiles.size());
+      for (size_t t = end; t > begin; t--) queues[w].tiles.push_back(tiles[t - 1]);
+    }
+  }
+
+  bool next(u32 worker, Tile &tile) {
+    return pop(worker, tile) || steal(worker, tile);
+  }
+
+private:
+  struct worker_queue {
+    std::mutex lock;
+    std::deque<Tile> tiles;
+  };
+  std::vector<worker_queue> queues;
+
+  bool pop(u32 worker, Tile &tile) {
+    worker_queue &queue = queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tiles.empty()) return false;
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+  }
+
+  bool steal(u32 thief, Tile &tile) {
+    u32 n = queues.size();
+    for (u32 k = 1; k < n; k++) {
+      worker_queue &victim = queues[(thief + k) % n];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (victim.tiles.empty()) continue;
+      tile = victim.tiles.front();
+      victim.tiles.pop_front();
+      return true;
+    }
+    return false;
+  }
+};
+
+// Renders every tile of the image with workers_count threads, render_tile is
+// called as render_tile(worker, tile) and must only touch its own tile.
+template <typename RenderTile>
+void run_tiles(i32 width, i32 height, i32 tile_size, u32 workers_count, RenderTile render_tile) {
+  if (workers_count < 1) workers_count = 1;
+  tile_scheduler scheduler(width, height, tile_size, workers_count);
+
+  auto worker_loop = [&](u32 worker) {
+    Tile tile;
+    while (scheduler.next(worker, tile)) render_tile(worker, tile);
+  };
+
+  std::vector<std::thread> workers;
+  for (u32 w = 1; w < workers_count; w++) workers.emplace_back(worker_loop, w);
+  worker_loop(0);
+  for (std::thread &t : workers) t.join();
+}
+
+#endif
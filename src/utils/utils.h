@@ -35,15 +35,17 @@
 #include <curand_kernel.h>
 typedef curandState randState;
 #define RANDOM_UNIFORM(curandState) curand_uniform(curandState)
+#define RANDOM_DIMENSION(curandState, dimension) ((void)0)
 #else
 #define DEVICE
 #define HOST
 
 #ifdef __cplusplus
-#include <random>
-typedef std::mt19937 randState;
-static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-#define RANDOM_UNIFORM(state) distribution(*state)
+#include "sampler.h"
+typedef sampler randState;
+#define RANDOM_UNIFORM(state) ((state)->next_f32())
+// Low discrepancy samplers continue the path at this dimension, see sampler.h
+#define RANDOM_DIMENSION(state, dimension) ((state)->set_dimension(dimension))
 #endif
 
 #endif